@@ -0,0 +1,419 @@
+/*
+ drama - recover the DRAMLayout of the memory controller from row-conflict
+ timing and write it for `tester --layout`. See README.md.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "types.h"
+#include "memory.h"
+#include "params.h"
+#include "dram-address.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+#define DR_POOL		4096	// random addresses sorted into bank sets
+#define DR_REPS		8	// timings of a pair, the fastest one counts
+#define DR_CAL_PAIRS	4096	// random pairs timed to pick the threshold
+#define DR_BIN		4	// cycles per histogram bin
+#define DR_BINS		1024
+#define DR_MAX_BANKS	64	// conflicts below 1 / (2 * DR_MAX_BANKS) of the pairs are noise
+#define DR_MIN_GAP	1.15	// conflicts slower than the other pairs by at least this
+#define DR_MIN_SET	8	// smaller sets are noise
+#define DR_AGREE	0.9	// share of every set a bank function holds on
+#define DR_MAX_WEIGHT	6	// bits of a bank function
+#define DR_BASES	16	// base addresses of the row bit votes
+#define DR_OUT_std	"layout.bin"
+
+ProfileParams *p;
+uint64_t g_t_start;
+DRAMLayout g_mem_layout;	// the solved layout, for init_dram_xlate()
+
+typedef struct {
+	char *v_addr;
+	physaddr_t p_addr;
+} DrAddr;
+
+typedef struct {
+	MemoryBuffer *mem;
+	uint64_t threshold;	// pairs this slow are row conflicts
+	DrAddr pool[DR_POOL];	// [0, pool_len) not sorted yet
+	size_t pool_len;
+	DrAddr sets[DR_POOL];	// set i is [set_end[i - 1], set_end[i])
+	size_t set_end[DR_POOL];
+	size_t n_sets;
+	int bit_hi;		// highest physical bit that differs in the buffer
+} Drama;
+
+/* Pair sweep of a share of the pool against a single base. */
+typedef struct {
+	Drama *dr;
+	char *base;
+	size_t lo, hi;
+	bool *hit;
+	pthread_t tid;
+} SweepJob;
+
+static uint64_t pair_min(char *a, char *b)
+{
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < DR_REPS; i++) {
+		uint64_t t = time_pair(a, b);
+		best = t < best ? t : best;
+	}
+	return best;
+}
+
+static bool conflict(Drama * dr, char *a, char *b)
+{
+	return pair_min(a, b) >= dr->threshold;
+}
+
+static void sample_pool(Drama * dr)
+{
+	MemoryBuffer *mem = dr->mem;
+	physaddr_t diff = 0;
+	for (size_t i = 0; i < DR_POOL; i++) {
+		uint64_t off = (((uint64_t) rand() << 31) ^ rand()) % mem->size;
+		dr->pool[i].v_addr = mem->buffer + (off & ~((uint64_t) CL_SIZE - 1));
+		dr->pool[i].p_addr = virt_2_phys(dr->pool[i].v_addr, mem);
+		diff |= dr->pool[i].p_addr ^ dr->pool[0].p_addr;
+	}
+	dr->pool_len = DR_POOL;
+	dr->bit_hi = 63 - __builtin_clzll(diff | 1);
+}
+
+/*
+ Pick the conflict threshold from the latency of random pairs. Only about
+ one pair in #banks is a row conflict, the split is the slow tail. A tail
+ far thinner than that or half of the pairs, or one hardly slower than the
+ rest, means the split found no conflicts and the sets would be noise.
+ */
+static void calibrate(Drama * dr)
+{
+	uint64_t *hist = (uint64_t *) calloc(DR_BINS, sizeof(uint64_t));
+	for (size_t i = 0; i < DR_CAL_PAIRS; i++) {
+		char *a = dr->pool[rand() % DR_POOL].v_addr;
+		char *b = dr->pool[rand() % DR_POOL].v_addr;
+		size_t bin = pair_min(a, b) / DR_BIN;
+		hist[bin < DR_BINS ? bin : DR_BINS - 1]++;
+	}
+	size_t split = otsu_split(hist, DR_BINS);
+	uint64_t slow = 0, sum[2] = { 0, 0 };
+	for (size_t i = 0; i < DR_BINS; i++) {
+		sum[i >= split] += hist[i] * i;
+		slow += i >= split ? hist[i] : 0;
+	}
+	double gap = slow && slow < DR_CAL_PAIRS ?
+	    ((double)sum[1] / slow) / ((double)sum[0] / (DR_CAL_PAIRS - slow)) : 0;
+	dr->threshold = split * DR_BIN;
+	fprintf(stderr, "[LOG] - Row conflict threshold: %ld cycles (%.1f%% of the pairs, %.2fx slower)\n",
+		dr->threshold, 100.0 * slow / DR_CAL_PAIRS, gap);
+	free(hist);
+	if (slow * 2 * DR_MAX_BANKS < DR_CAL_PAIRS || slow * 2 >= DR_CAL_PAIRS || gap < DR_MIN_GAP) {
+		fprintf(stderr, "[ERROR] - No row conflicts to tell apart, the threshold is noise\n");
+		exit(1);
+	}
+}
+
+static void *sweep_loop(void *arg)
+{
+	SweepJob *job = (SweepJob *) arg;
+	for (size_t i = job->lo; i < job->hi; i++)
+		job->hit[i] = conflict(job->dr, job->base, job->dr->pool[i].v_addr);
+	return NULL;
+}
+
+/* hit[i]: pool[i] conflicts with base, the pool split over p->threads. */
+static void sweep(Drama * dr, char *base, bool *hit)
+{
+	size_t n = p->threads;
+	SweepJob job[MAX_THREADS];
+	for (size_t t = 0; t < n; t++) {
+		job[t].dr = dr;
+		job[t].base = base;
+		job[t].lo = dr->pool_len * t / n;
+		job[t].hi = dr->pool_len * (t + 1) / n;
+		job[t].hit = hit;
+		if (t && pthread_create(&job[t].tid, NULL, sweep_loop, &job[t])) {
+			perror("[ERROR] - pthread_create() failed");
+			exit(1);
+		}
+	}
+	sweep_loop(&job[0]);
+	for (size_t t = 1; t < n; t++)
+		pthread_join(job[t].tid, NULL);
+}
+
+/*
+ Sort the pool into bank sets: every base takes the addresses it conflicts
+ with. Threads of the sweep disturb each other, so with --threads the
+ hits are timed again by the main thread before they join the set.
+ */
+static void find_sets(Drama * dr)
+{
+	bool *hit = (bool *) malloc(sizeof(bool) * DR_POOL);
+	size_t sorted = 0;
+
+	while (dr->pool_len > DR_MIN_SET) {
+		DrAddr base = dr->pool[--dr->pool_len];
+		sweep(dr, base.v_addr, hit);
+
+		size_t start = sorted;
+		dr->sets[sorted++] = base;
+		for (size_t i = 0; i < dr->pool_len; i++) {
+			hit[i] = hit[i] && (p->threads == 1 || conflict(dr, base.v_addr, dr->pool[i].v_addr));
+			if (hit[i])
+				dr->sets[sorted++] = dr->pool[i];
+		}
+		if (sorted - start < DR_MIN_SET) {
+			sorted = start;	// base was noise, drop it
+			continue;
+		}
+
+		size_t left = 0;
+		for (size_t i = 0; i < dr->pool_len; i++)
+			if (!hit[i])
+				dr->pool[left++] = dr->pool[i];
+		dr->pool_len = left;
+		dr->set_end[dr->n_sets++] = sorted;
+		if (p->g_flags & F_VERBOSE)
+			fprintf(stderr, "[LOG] - Set %ld: %ld addresses, %ld left\n", dr->n_sets,
+				sorted - start, dr->pool_len);
+	}
+	free(hit);
+}
+
+static bool parity(uint64_t v)
+{
+	return __builtin_parityll(v);
+}
+
+/* fn has the same parity over DR_AGREE of every set and isn't constant. */
+static bool fn_holds(Drama * dr, uint64_t fn)
+{
+	int seen = 0;
+	for (size_t s = 0, lo = 0; s < dr->n_sets; lo = dr->set_end[s++]) {
+		size_t n = dr->set_end[s] - lo, ones = 0;
+		for (size_t i = lo; i < dr->set_end[s]; i++)
+			ones += parity(dr->sets[i].p_addr & fn);
+		size_t major = ones * 2 > n ? ones : n - ones;
+		if (major < DR_AGREE * n)
+			return false;
+		seen |= 1 << (ones * 2 > n);
+	}
+	return seen == 3;
+}
+
+/* Next mask with the same number of bits (Gosper's hack). */
+static uint64_t next_comb(uint64_t x)
+{
+	uint64_t c = x & -x;
+	uint64_t r = x + c;
+	return (((r ^ x) >> 2) / c) | r;
+}
+
+/* Insert v into the GF(2) basis piv, false if it's already spanned. */
+static bool basis_add(uint64_t * piv, uint64_t v)
+{
+	for (int b = 63; b >= 0; b--) {
+		if (!(v >> b & 1))
+			continue;
+		if (!piv[b]) {
+			piv[b] = v;
+			return true;
+		}
+		v ^= piv[b];
+	}
+	return false;
+}
+
+/*
+ Bank functions: the masks of up to DR_MAX_WEIGHT bits over [CL_SHIFT,
+ bit_hi] that hold on every set, lightest first, as long as they are
+ independent.
+ */
+static size_t solve_fns(Drama * dr, uint64_t * fns)
+{
+	int bits = dr->bit_hi - CL_SHIFT + 1;
+	uint64_t piv[64];
+	size_t len = 0;
+	memset(piv, 0x00, sizeof(piv));
+
+	for (int w = 1; w <= DR_MAX_WEIGHT && w <= bits; w++) {
+		for (uint64_t c = (1ULL << w) - 1; c < 1ULL << bits; c = next_comb(c)) {
+			uint64_t fn = c << CL_SHIFT;
+			if (!fn_holds(dr, fn) || !basis_add(piv, fn))
+				continue;
+			if (len == HASH_FN_CNT) {
+				fprintf(stderr, "[ERROR] - More than %d bank functions, the sets are noise\n",
+					HASH_FN_CNT);
+				exit(1);
+			}
+			fns[len++] = fn;
+		}
+	}
+	return len;
+}
+
+/* Majority vote of DR_BASES pool addresses: does flipping mask conflict? */
+static bool flip_conflicts(Drama * dr, uint64_t mask)
+{
+	int votes = 0, cnt = 0;
+	for (size_t i = 0; i < dr->n_sets && cnt < DR_BASES; i++) {
+		DrAddr *a = &dr->sets[i ? dr->set_end[i - 1] : 0];
+		char *b = phys_2_virt(a->p_addr ^ mask, dr->mem);
+		if (b == (char *)NOT_FOUND)
+			continue;
+		votes += conflict(dr, a->v_addr, b);
+		cnt++;
+	}
+	return cnt && votes * 2 > cnt;
+}
+
+/*
+ Row bits: a bit in no bank function is a row bit if flipping it
+ conflicts. A bank bit is flipped with the lowest bit of the same
+ functions, which keeps the bank. Bits below the lowest row bit are
+ assumed to be column or bank bits, the row is contiguous up to bit_hi.
+ */
+static uint64_t solve_rows(Drama * dr, uint64_t * fns, size_t len)
+{
+	int lo = -1;
+	for (int k = CL_SHIFT; k <= dr->bit_hi && lo < 0; k++) {
+		uint64_t in = 0;
+		for (size_t i = 0; i < len; i++)
+			in |= (uint64_t) (fns[i] >> k & 1) << i;
+		uint64_t mask = 1ULL << k;
+		if (in) {
+			int j = CL_SHIFT;
+			for (; j < k; j++) {
+				uint64_t in_j = 0;
+				for (size_t i = 0; i < len; i++)
+					in_j |= (uint64_t) (fns[i] >> j & 1) << i;
+				if (in_j == in)
+					break;
+			}
+			if (j == k)
+				continue;	// lowest bit of its functions
+			mask |= 1ULL << j;
+		}
+		if (flip_conflicts(dr, mask))
+			lo = k;
+	}
+	if (lo < 0) {
+		fprintf(stderr, "[ERROR] - No row bits found\n");
+		exit(1);
+	}
+	return ((dr->bit_hi < 63 ? 2ULL << dr->bit_hi : 0) - 1) & ~((1ULL << lo) - 1);
+}
+
+/* Share of the sorted addresses that the layout puts in the bank of their set. */
+static double check_sets(Drama * dr)
+{
+	size_t ok = 0, total = 0;
+	for (size_t s = 0, lo = 0; s < dr->n_sets; lo = dr->set_end[s++]) {
+		uint64_t *cnt = (uint64_t *) calloc(get_banks_cnt(), sizeof(uint64_t));
+		uint64_t best = 0;
+		for (size_t i = lo; i < dr->set_end[s]; i++) {
+			uint64_t bk = phys_2_dram(dr->sets[i].p_addr).bank;
+			best = ++cnt[bk] > best ? cnt[bk] : best;
+		}
+		ok += best;
+		total += dr->set_end[s] - lo;
+		free(cnt);
+	}
+	return total ? 100.0 * ok / total : 0;
+}
+
+/**
+Inputs: mem - the buffer, physmap set
+        out_name - where to write the layout
+
+Output: 0 on success, -1 otherwise
+*/
+int drama_run(MemoryBuffer * mem, const char *out_name)
+{
+	Drama *dr = (Drama *) calloc(1, sizeof(Drama));
+	if (dr == NULL) {
+		fprintf(stderr, "[ERROR] - Unable to allocate the address pool\n");
+		exit(1);
+	}
+	dr->mem = mem;
+
+	uint64_t t0 = realtime_now();
+	sample_pool(dr);
+	calibrate(dr);
+	find_sets(dr);
+	uint64_t t1 = realtime_now();
+	fprintf(stderr, "[LOG] - %ld bank sets, %ld addresses unsorted\n", dr->n_sets,
+		dr->pool_len);
+
+	DRAMLayout *layout = &g_mem_layout;
+	memset(layout, 0x00, sizeof(DRAMLayout));
+	layout->h_fns.len = solve_fns(dr, layout->h_fns.lst);
+	if (layout->h_fns.len == 0) {
+		fprintf(stderr, "[ERROR] - No bank functions found\n");
+		exit(1);
+	}
+	if ((1ULL << layout->h_fns.len) != dr->n_sets)
+		fprintf(stderr, "[LOG] - %ld functions for %ld sets, some banks were missed or split\n",
+			layout->h_fns.len, dr->n_sets);
+	layout->row_mask = solve_rows(dr, layout->h_fns.lst, layout->h_fns.len);
+	layout->col_mask = ROW_SIZE - 1;
+	print_time("sets", t1 - t0);
+	print_time("solve", realtime_now() - t1);
+
+	fprintf(stderr, "[LOG] - Layout: %s", dramLayout_2_str(layout));
+	init_dram_xlate();
+	fprintf(stderr, "[LOG] - %.1f%% of the sorted addresses agree with the layout\n",
+		check_sets(dr));
+
+	int res = save_dram_layout(out_name, layout);
+	if (res)
+		perror("[ERROR] - Unable to write the layout");
+	else
+		fprintf(stderr, "[LOG] - File: %s\n", out_name);
+	free(dr);
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	startup();
+	g_t_start = realtime_now();
+	p = (ProfileParams *) malloc(sizeof(ProfileParams));
+	if (p == NULL) {
+		fprintf(stderr, "[ERROR] Memory allocation\n");
+		exit(1);
+	}
+	if (process_argv(argc, argv, p) == -1) {
+		free(p);
+		exit(1);
+	}
+	fprintf(stderr, "[LOG] - Clock: %.3f ns/tick\n", calib_clock());
+
+	MemoryBuffer mem = {
+		.buffer = NULL,
+		.physmap = NULL,
+		.fd = p->huge_fd,
+		.size = p->m_size,
+		.align = p->m_align,
+		.flags = p->g_flags & MEM_MASK
+	};
+	build_buffer(&mem);
+	set_physmap(&mem);
+
+	int res = drama_run(&mem, p->layout ? p->layout : DR_OUT_std);
+	tear_down_buff(&mem);
+	close(p->huge_fd);
+	return res ? 1 : 0;
+}
@@ -3,8 +3,15 @@
 pid=$(ps aux | grep 'tester' | grep -v 'grep' | awk 'NR==1 {print $2}')
 
 if [[ -n "$pid" ]]; then
+    # SIGTERM lets a fuzzing session flush its fliptable and checkpoint
+    echo "Stopping process with PID: $pid"
+    kill -TERM $pid
+    for i in $(seq 30); do
+        kill -0 $pid 2>/dev/null || exit 0
+        sleep 1
+    done
     echo "Killing process with PID: $pid"
-    kill -9 $pid  
+    kill -9 $pid
 else
     echo "No process found matching 'tester'"
 fi
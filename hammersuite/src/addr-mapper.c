@@ -10,80 +10,99 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
-static size_t g_rmap_len = 0;
-static size_t g_base_row = 0;
-static size_t g_bks = 0;
-static size_t g_rows = 0;
+#define PAGE_OFF(x)	((x) & ((uint64_t) PAGE_SIZE - 1))
 
-RowMap get_row_map(ADDRMapper * mapper, DRAMAddr * d_addr)
+static inline size_t rmap_idx(ADDRMapper * mapper, size_t bk, size_t row)
 {
-	size_t idx =
-	    (d_addr->row - g_base_row) * get_banks_cnt() + d_addr->bank;
-	assert(idx < g_bks * g_rows);
-	return mapper->row_maps[idx];
+	return row * mapper->bks + bk;
 }
 
-DRAM_pte get_dram_pte(ADDRMapper * mapper, DRAMAddr * d_addr)
+/*
+ Slow path of get_row_map(). Init threads, pool workers and the pipeline
+ helper share row_off, so it's only accessed with relaxed atomics:
+ concurrent callers may both compute the offset and store the same value.
+ */
+static uint32_t __attribute__ ((noinline))
+populate_row(ADDRMapper * mapper, size_t idx, DRAMAddr * d_addr)
 {
-	RowMap rmap = get_row_map(mapper, d_addr);
-	return rmap.lst[(d_addr->col) >> 6];
+	DRAMAddr d_tmp = {.bank = d_addr->bank,.row = d_addr->row,.col = 0 };
+	physaddr_t p_addr = dram_2_phys(d_tmp, mapper->mem);
+	assert(phys_2_virt(p_addr, mapper->mem) != (char *)NOT_FOUND);
+	uint32_t off = PAGE_OFF(p_addr);
+	__atomic_store_n(&mapper->row_off[idx], off, __ATOMIC_RELAXED);
+	return off;
 }
 
-RowMap gen_row_map(DRAMAddr d_src, MemoryBuffer * mem)
+RowMap get_row_map(ADDRMapper * mapper, DRAMAddr * d_addr)
 {
-	RowMap rmap;
-	DRAM_pte *dst = (DRAM_pte *) malloc(sizeof(DRAM_pte) * g_rmap_len);
-	d_src.col = 0;
+	size_t idx = rmap_idx(mapper, d_addr->bank, d_addr->row - mapper->base_row);
+	assert(idx < mapper->bks * mapper->rows);
 
-	for (size_t col = 0; col < g_rmap_len; col++, d_src.col += (1 << 6)) {
-		dst[col].d_addr = d_src;
-		dst[col].v_addr = phys_2_virt(dram_2_phys(d_src, mem), mem);
-		// fprintf(stderr, "try v_addr\n");
-		// fprintf(stderr, "bk%ld/r%ld/col%ld \t%p \t%lx\n", d_src.bank, d_src.row, d_src.col, dst[col].v_addr, dram_2_phys(d_src, mem));
+	uint32_t off = __atomic_load_n(&mapper->row_off[idx], __ATOMIC_RELAXED);
+	if (__builtin_expect(off == ROW_UNMAPPED, 0))
+		off = populate_row(mapper, idx, d_addr);
 
-	}
-	rmap.lst = dst;
-	rmap.len = g_rmap_len;
+	RowMap rmap = {
+		.v_base = mapper->v_base,
+		.off = off,
+		.col_off = mapper->col_off,
+		.len = ROW_SIZE / CL_SIZE
+	};
 	return rmap;
-
 }
 
-size_t rmap_idx(size_t bk, size_t row)
+DRAM_pte get_dram_pte(ADDRMapper * mapper, DRAMAddr * d_addr)
 {
-	return row * get_banks_cnt() + bk;
+	RowMap rmap = get_row_map(mapper, d_addr);
+	DRAM_pte pte;
+	pte.d_addr = *d_addr;
+	pte.d_addr.col &= ~((uint64_t) CL_SIZE - 1);
+	pte.v_addr = rmap_cl(&rmap, d_addr->col >> CL_SHIFT);
+	return pte;
 }
 
 void init_addr_mapper(ADDRMapper * mapper, MemoryBuffer * mem,
 		      DRAMAddr * d_base, size_t h_rows)
 {
-	mapper->row_maps =
-	    (RowMap *) malloc(sizeof(RowMap) * h_rows * get_banks_cnt());
+	if (!mem->xlate.contig) {
+		fprintf(stderr, "[ERROR] - ADDRMapper needs physically contiguous memory\n");
+		exit(1);
+	}
+	mapper->mem = mem;
 	mapper->base_row = d_base->row;
-	g_base_row = d_base->row;
-	g_bks = get_banks_cnt();
-	g_rows = h_rows;
-	// set global rmap_len
-	g_rmap_len = ROW_SIZE / CL_SIZE;
+	mapper->rows = h_rows;
+	mapper->bks = get_banks_cnt();
+	// virtual address that maps to the start of the physical page
+	mapper->v_base = mem->buffer - PAGE_OFF(mem->xlate.p_base);
+	mapper->row_off = (uint32_t *) malloc(sizeof(uint32_t) * h_rows * mapper->bks);
+	assert(mapper->row_off != NULL);
+
+	// column deltas don't depend on the row or the bank
+	DRAMAddr d_tmp = {.bank = 0,.row = d_base->row,.col = 0 };
+	physaddr_t p_col0 = dram_2_phys(d_tmp, mem);
+	for (size_t cl = 0; cl < ROW_SIZE / CL_SIZE; cl++) {
+		d_tmp.col = cl << CL_SHIFT;
+		mapper->col_off[cl] = PAGE_OFF(dram_2_phys(d_tmp, mem) ^ p_col0);
+	}
+
+	// rows are only translated when they are first touched
+	memset(mapper->row_off, 0xff, sizeof(uint32_t) * h_rows * mapper->bks);
 
-	// create ptes list for every
-	DRAMAddr d_tmp = {.bank = 0,.row = 0,.col = 0 };
-	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+	// cross-check the first row of every bank against the full translation
+	for (size_t bk = 0; bk < mapper->bks; bk++) {
 		d_tmp.bank = bk;
-		for (size_t row = 0; row < h_rows; row++) {
-			d_tmp.row = g_base_row + row;
-			mapper->row_maps[rmap_idx(bk, row)] = gen_row_map(d_tmp, mem);
-			// fprintf(stderr, "mapper->row_maps[%ld]: row_map bk%ld/r%ld/col%ld, %p\n",rmap_idx(bk, row), gen_row_map(d_tmp, mem).lst->d_addr.bank, 
-			// gen_row_map(d_tmp, mem).lst->d_addr.row, gen_row_map(d_tmp, mem).lst->d_addr.col, gen_row_map(d_tmp, mem).lst->v_addr);
+		d_tmp.row = mapper->base_row;
+		for (d_tmp.col = 0; d_tmp.col < ROW_SIZE; d_tmp.col += CL_SIZE) {
+			assert(get_dram_pte(mapper, &d_tmp).v_addr ==
+			       phys_2_virt(dram_2_phys(d_tmp, mem), mem));
 		}
 	}
-	// assert(false);
 }
 
 void tear_down_addr_mapper(ADDRMapper * mapper)
 {
-	for (int i = 1; i < g_rows * g_bks; i++) {
-		free(mapper->row_maps[i].lst);
-	}
-	free(mapper->row_maps);
+	free(mapper->row_off);
+	mapper->row_off = NULL;
 }
@@ -0,0 +1,334 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "utils.h"
+#include "dram-address.h"
+#include "jit.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+#define BENCH_REPS	5		// best of BENCH_REPS runs is reported
+#define XLATE_ADDRS	(1<<20)
+#define SCAN_BYTES	MB(64UL)
+#define SCAN_ROWS	8		// rows flushed per fence, as in scan_rows()
+#define JIT_ROUNDS	50000
+
+typedef struct {
+	const char *name;
+	int (*run) (void);
+} Bench;
+
+static uint64_t xorshift(uint64_t * s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+// best: realtime_now() ticks
+static void report(const char *name, uint64_t best, size_t cnt)
+{
+	fprintf(stderr, "[BENCH] - %-24s %8.2f ns/addr\n", name, (double)ticks_2_ns(best) / cnt);
+}
+
+static void report_bw(const char *name, uint64_t best, size_t bytes)
+{
+	fprintf(stderr, "[BENCH] - %-24s %8.2f GB/s\n", name, (double)bytes / ticks_2_ns(best));
+}
+
+/*
+ ns/address of phys_2_dram/dram_2_phys, one address at a time and through
+ the batch calls, over random addresses of a 1GB page.
+ */
+static int bench_xlate()
+{
+	physaddr_t *p_lst = (physaddr_t *) malloc(sizeof(physaddr_t) * XLATE_ADDRS);
+	physaddr_t *p_inv = (physaddr_t *) malloc(sizeof(physaddr_t) * XLATE_ADDRS);
+	DRAMAddr *d_lst = (DRAMAddr *) malloc(sizeof(DRAMAddr) * XLATE_ADDRS);
+	DRAMAddr *d_bat = (DRAMAddr *) malloc(sizeof(DRAMAddr) * XLATE_ADDRS);
+	MemoryBuffer mem;
+	uint64_t seed = 0xdeadbeefcafef00dULL;
+	uint64_t best[4] = { UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX };
+
+	memset(&mem, 0x00, sizeof(MemoryBuffer));
+	for (size_t i = 0; i < XLATE_ADDRS; i++)
+		p_lst[i] = xorshift(&seed) & (PAGE_SIZE - 1);
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		uint64_t t0 = realtime_now();
+		for (size_t i = 0; i < XLATE_ADDRS; i++)
+			d_lst[i] = phys_2_dram(p_lst[i]);
+		uint64_t t1 = realtime_now();
+		phys_2_dram_batch(p_lst, d_bat, XLATE_ADDRS);
+		uint64_t t2 = realtime_now();
+		for (size_t i = 0; i < XLATE_ADDRS; i++)
+			p_inv[i] = dram_2_phys(d_lst[i], &mem);
+		uint64_t t3 = realtime_now();
+		dram_2_phys_batch(d_bat, p_inv, XLATE_ADDRS, &mem);
+		uint64_t t4 = realtime_now();
+
+		uint64_t t[4] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3 };
+		for (int k = 0; k < 4; k++)
+			best[k] = t[k] < best[k] ? t[k] : best[k];
+	}
+
+	int errors = 0;
+	for (size_t i = 0; i < XLATE_ADDRS; i++) {
+		if (!d_addr_eq(&d_lst[i], &d_bat[i]) || p_inv[i] != dram_2_phys(d_lst[i], &mem))
+			errors++;
+	}
+
+	report("phys_2_dram", best[0], XLATE_ADDRS);
+	report("phys_2_dram_batch", best[1], XLATE_ADDRS);
+	report("dram_2_phys", best[2], XLATE_ADDRS);
+	report("dram_2_phys_batch", best[3], XLATE_ADDRS);
+	if (errors)
+		fprintf(stderr, "[ERROR] - %d batch results differ\n", errors);
+
+	free(p_lst);
+	free(p_inv);
+	free(d_lst);
+	free(d_bat);
+	return errors ? -1 : 0;
+}
+
+/* What the row scan did before: clflush + cpuid and a byte loop per line. */
+static uint64_t scan_legacy(char *buf, size_t len, uint8_t val)
+{
+	uint64_t flips = 0;
+	for (size_t cl = 0; cl < len; cl += CL_SIZE) {
+		clflush(buf + cl);
+		cpuid();
+		uint64_t res = 0;
+		for (int i = 0; i < CL_SIZE; i++) {
+			if (*(uint8_t *) (buf + cl + i) != val)
+				res |= 1UL << i;
+		}
+		flips += __builtin_popcountll(res);
+	}
+	return flips;
+}
+
+static uint64_t scan_batched(char *buf, size_t len, uint8_t val)
+{
+	uint64_t flips = 0;
+	for (size_t off = 0; off < len; off += SCAN_ROWS * ROW_SIZE) {
+		char *end = buf + off + SCAN_ROWS * ROW_SIZE;
+		for (char *cl = buf + off; cl < end; cl += CL_SIZE)
+			clflushopt(cl);
+		mfence();
+		for (char *cl = buf + off; cl < end; cl += CL_SIZE)
+			flips += __builtin_popcountll(cl_diff_val(cl, val));
+	}
+	return flips;
+}
+
+/*
+ Scan throughput (flush + compare) of a 64MB buffer with a few planted flips,
+ the per-line serialized scan against the batched SIMD one.
+ */
+static int bench_scan()
+{
+	char *buf = (char *)mmap(NULL, SCAN_BYTES, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("[ERROR] - mmap() failed");
+		return -1;
+	}
+	uint64_t seed = 0x0123456789abcdefULL;
+	uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+	uint64_t flips[2];
+	size_t planted = 0;
+
+	memset(buf, 0x55, SCAN_BYTES);
+	for (int i = 0; i < 64; i++) {
+		size_t off = xorshift(&seed) % SCAN_BYTES;
+		planted += buf[off] == 0x55;
+		buf[off] = 0x54;
+	}
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		uint64_t t0 = realtime_now();
+		flips[0] = scan_legacy(buf, SCAN_BYTES, 0x55);
+		uint64_t t1 = realtime_now();
+		flips[1] = scan_batched(buf, SCAN_BYTES, 0x55);
+		uint64_t t2 = realtime_now();
+
+		best[0] = t1 - t0 < best[0] ? t1 - t0 : best[0];
+		best[1] = t2 - t1 < best[1] ? t2 - t1 : best[1];
+	}
+
+	report_bw("scan clflush+cpuid", best[0], SCAN_BYTES);
+	report_bw("scan batched simd", best[1], SCAN_BYTES);
+	int errors = flips[0] != planted || flips[1] != planted;
+	if (errors)
+		fprintf(stderr, "[ERROR] - Found %lu/%lu flips, %lu planted\n",
+			flips[0], flips[1], planted);
+
+	munmap(buf, SCAN_BYTES);
+	return errors ? -1 : 0;
+}
+
+/*
+ Random data initialisation of a 64MB buffer, cl_rand_gen + memcpy as
+ init_random() used to do against the streaming cl_rand_stream.
+ */
+static int bench_init()
+{
+	char *buf = (char *)mmap(NULL, SCAN_BYTES, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("[ERROR] - mmap() failed");
+		return -1;
+	}
+	uint64_t seed = 0x7bc661612e71168cULL;
+	uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+	DRAMAddr d_tmp = { 0, 0, 0 };
+	int errors = 0;
+
+	for (int rep = 0; rep < BENCH_REPS; rep++) {
+		uint64_t t0 = realtime_now();
+		for (size_t cl = 0; cl < SCAN_BYTES; cl += CL_SIZE) {
+			d_tmp.row = cl / ROW_SIZE;
+			d_tmp.col = cl % ROW_SIZE;
+			memcpy(buf + cl, cl_rand_gen(&d_tmp, seed), CL_SIZE);
+		}
+		uint64_t t1 = realtime_now();
+		for (size_t cl = 0; cl < SCAN_BYTES; cl += CL_SIZE) {
+			d_tmp.row = cl / ROW_SIZE;
+			d_tmp.col = cl % ROW_SIZE;
+			cl_rand_stream(buf + cl, &d_tmp, seed);
+		}
+		sfence();
+		uint64_t t2 = realtime_now();
+
+		best[0] = t1 - t0 < best[0] ? t1 - t0 : best[0];
+		best[1] = t2 - t1 < best[1] ? t2 - t1 : best[1];
+	}
+
+	for (size_t cl = 0; cl < SCAN_BYTES; cl += CL_SIZE) {
+		d_tmp.row = cl / ROW_SIZE;
+		d_tmp.col = cl % ROW_SIZE;
+		errors += cl_diff(buf + cl, cl_rand_gen(&d_tmp, seed)) != 0;
+	}
+
+	report_bw("init memcpy", best[0], SCAN_BYTES);
+	report_bw("init streaming", best[1], SCAN_BYTES);
+	if (errors)
+		fprintf(stderr, "[ERROR] - %d lines differ from cl_rand_gen\n", errors);
+
+	munmap(buf, SCAN_BYTES);
+	return errors ? -1 : 0;
+}
+
+/* The uniform loop of hammer_it(). */
+static void hammer_loop(char **v_lst, size_t len, size_t rounds)
+{
+	for (size_t i = 0; i < rounds; i++) {
+		mfence();
+		for (size_t j = 0; j < len; j++)
+			*(volatile char *)v_lst[j];
+		for (size_t j = 0; j < len; j++)
+			clflushopt(v_lst[j]);
+	}
+}
+
+/*
+ Accesses/s of the interpreted hammer loop against the compiled kernel of
+ the same schedule, with all aggressors in registers (8) and with some
+ reloaded from v_lst (20).
+ */
+static int bench_jit()
+{
+	char *buf = (char *)mmap(NULL, SCAN_BYTES, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("[ERROR] - mmap() failed");
+		return -1;
+	}
+	size_t lens[] = { 8, 20 };
+	char *v_lst[20];
+	JitKernel k;
+	memset(&k, 0x00, sizeof(JitKernel));
+	for (size_t i = 0; i < 20; i++)
+		v_lst[i] = buf + i * (SCAN_BYTES / 20) / ROW_SIZE * ROW_SIZE;
+
+	for (size_t l = 0; l < sizeof(lens) / sizeof(size_t); l++) {
+		size_t len = lens[l];
+		jit_reset(&k);
+		jit_op(&k, JIT_FENCE, 0);
+		for (size_t j = 0; j < len; j++)
+			jit_op(&k, JIT_ACCESS, j);
+		for (size_t j = 0; j < len; j++)
+			jit_op(&k, JIT_FLUSH, j);
+		JitFn fn = jit_compile(&k, len);
+
+		uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+		for (int rep = 0; rep < BENCH_REPS; rep++) {
+			uint64_t t0 = realtime_now();
+			hammer_loop(v_lst, len, JIT_ROUNDS);
+			uint64_t t1 = realtime_now();
+			if (fn)
+				fn(v_lst, JIT_ROUNDS);
+			uint64_t t2 = realtime_now();
+
+			best[0] = t1 - t0 < best[0] ? t1 - t0 : best[0];
+			best[1] = t2 - t1 < best[1] ? t2 - t1 : best[1];
+		}
+		char name[32];
+		sprintf(name, "hammer loop %ld aggr", len);
+		fprintf(stderr, "[BENCH] - %-24s %8.2f M acc/s\n", name, len * JIT_ROUNDS * 1e3 / ticks_2_ns(best[0]));
+		if (!fn) {
+			fprintf(stderr, "[BENCH] - no JIT on this architecture\n");
+			continue;
+		}
+		sprintf(name, "hammer jit %ld aggr", len);
+		fprintf(stderr, "[BENCH] - %-24s %8.2f M acc/s (%ld bytes)\n", name,
+			len * JIT_ROUNDS * 1e3 / ticks_2_ns(best[1]), k.len);
+	}
+
+	jit_free(&k);
+	munmap(buf, SCAN_BYTES);
+	return 0;
+}
+
+static Bench benches[] = {
+	{"xlate", bench_xlate},
+	{"scan", bench_scan},
+	{"init", bench_init},
+	{"jit", bench_jit},
+};
+
+/**
+Inputs: name - benchmark to run, "all" runs every benchmark
+
+Microbenchmarks of the hot paths of the tester. They don't hammer and don't need
+the hugetlbfs entry.
+
+Output: 0 on success, -1 on failure or unknown benchmark
+*/
+int run_bench(const char *name)
+{
+	int found = 0, res = 0;
+	for (size_t i = 0; i < sizeof(benches) / sizeof(Bench); i++) {
+		if (strcmp(name, "all") && strcmp(name, benches[i].name))
+			continue;
+		found = 1;
+		fprintf(stderr, "[BENCH] - %s\n", benches[i].name);
+		res |= benches[i].run();
+	}
+	if (!found) {
+		fprintf(stderr, "[ERROR] - Unknown benchmark %s\n", name);
+		return -1;
+	}
+	return res;
+}
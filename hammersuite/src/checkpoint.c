@@ -0,0 +1,57 @@
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+Inputs: f_name - checkpoint file
+        ck - where to load the checkpoint
+
+Output: 0 on success, -1 if there's no checkpoint. Exits on a malformed
+        one rather than letting the session start over its output.
+*/
+int ckpt_load(const char *f_name, Checkpoint * ck)
+{
+	FILE *fp = fopen(f_name, "rb");
+	if (fp == NULL)
+		return -1;
+	int res = fread(ck, sizeof(Checkpoint), 1, fp) == 1 ? 0 : -1;
+	fclose(fp);
+	if (res || strncmp(ck->magic, CKPT_MAGIC, sizeof(ck->magic)) || ck->version != CKPT_VERSION) {
+		fprintf(stderr, "[ERROR] - %s is not a version %d checkpoint\n", f_name, CKPT_VERSION);
+		exit(1);
+	}
+	return 0;
+}
+
+/**
+Inputs: f_name - checkpoint file
+        ck - checkpoint to save
+
+Writes a temporary file and renames it over f_name, so a crash leaves
+either the old or the new checkpoint on disk.
+
+Output: none
+*/
+void ckpt_save(const char *f_name, Checkpoint * ck)
+{
+	char *tmp_name = (char *)malloc(strlen(f_name) + 5);
+	sprintf(tmp_name, "%s.tmp", f_name);
+	strncpy(ck->magic, CKPT_MAGIC, sizeof(ck->magic));
+	ck->version = CKPT_VERSION;
+
+	int fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, ck, sizeof(Checkpoint)) != sizeof(Checkpoint) || fsync(fd)) {
+		perror("[ERROR] - Unable to write the checkpoint");
+		exit(1);
+	}
+	close(fd);
+	if (rename(tmp_name, f_name)) {
+		perror("[ERROR] - Unable to write the checkpoint");
+		exit(1);
+	}
+	free(tmp_name);
+}
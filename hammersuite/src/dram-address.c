@@ -5,6 +5,7 @@
 
 #include "utils.h"
 #include "memory.h"
+#include "dram-xlate.h"
 
 #ifdef NUC
 #include "utils-intel.h"
@@ -12,82 +13,78 @@
 #include "utils-arm.h"
 #endif
 
-#define DEBUG_REVERSE_FN 1
+#define XLATE_SAMPLES	(1<<16)	// addresses checked by the startup self-test
 
 extern DRAMLayout g_mem_layout;
 
-uint64_t get_dram_row(physaddr_t p_addr)
+static DRAMXlate g_xlate;
+
+/**
+Inputs: none
+
+Compile g_mem_layout into the translator used by phys_2_dram/dram_2_phys and
+check it once against the layout. Must run before any translation.
+
+Output: none
+*/
+void init_dram_xlate()
 {
-	return (p_addr & g_mem_layout.
-		row_mask) >> __builtin_ctzl(g_mem_layout.row_mask);
+	if (xlate_compile(&g_xlate, &g_mem_layout)) {
+		fprintf(stderr, "[ERROR] - Bank functions can't be inverted: %s",
+			dramLayout_2_str(&g_mem_layout));
+		exit(1);
+	}
+	int errors = xlate_self_test(&g_xlate, &g_mem_layout, XLATE_SAMPLES);
+	if (errors) {
+		fprintf(stderr, "[ERROR] - Address translation self-test failed (%d)\n",
+			errors);
+		exit(1);
+	}
+	fprintf(stderr, "[ XL ] - Translator:   %s, self-test passed\n",
+		g_xlate.bmi2 ? "pext/pdep" : "lookup tables");
 }
 
 DRAMAddr phys_2_dram(physaddr_t p_addr)
 {
-
-	DRAMAddr res = { 0, 0, 0 };
-	for (int i = 0; i < g_mem_layout.h_fns.len; i++) {
-		res.bank |=
-		    (__builtin_parityl(p_addr & g_mem_layout.h_fns.lst[i]) <<
-		     i);
-	}
-
-	res.row = get_dram_row(p_addr);
-	res.col = get_dram_col(p_addr, g_mem_layout);
-
-	return res;
+	return xlate_fwd(&g_xlate, p_addr);
 }
 
 physaddr_t dram_2_phys(DRAMAddr d_addr, MemoryBuffer *mem)
 {
-	physaddr_t p_addr = 0;
-	uint64_t col_val = 0;
-
-	p_addr = (d_addr.row << __builtin_ctzl(g_mem_layout.row_mask));	// set row bits
-	p_addr |= col_2_phys(d_addr, g_mem_layout);
-
-	for (int i = 0; i < g_mem_layout.h_fns.len; i++) {
-		uint64_t masked_addr = p_addr & g_mem_layout.h_fns.lst[i];
-		// if the address already respects the h_fn then just move to the next func
-		if (__builtin_parity(masked_addr) == ((d_addr.bank >> i) & 1L)) {
-			continue;
-		}
-		// else flip a bit of the address so that the address respects the dram h_fn
-		// that is get only bits not affecting the row.
-		uint64_t h_lsb = __builtin_ctzl((g_mem_layout.h_fns.lst[i]) &
-						~(g_mem_layout.col_mask) &
-						~(g_mem_layout.row_mask));
-		p_addr ^= 1 << h_lsb;
-	}
-	
-	uint64_t physical_base = virt_2_phys(mem->buffer, mem);
-
-	p_addr |= physical_base & ~(((uint64_t) PAGE_SIZE - 1));
+	return xlate_inv(&g_xlate, d_addr) |
+	    (mem->xlate.p_base & ~(((uint64_t) PAGE_SIZE - 1)));
+}
 
+/**
+Inputs: p_lst - physical addresses
+        d_lst - output, len entries
+        len - number of addresses
 
+Batch version of phys_2_dram().
 
-#if DEBUG_REVERSE_FN
-	int correct = 1;
-	for (int i = 0; i < g_mem_layout.h_fns.len; i++) {
+Output: none
+*/
+void phys_2_dram_batch(physaddr_t *p_lst, DRAMAddr *d_lst, size_t len)
+{
+	xlate_fwd_batch(&g_xlate, p_lst, d_lst, len);
+}
 
-		if (__builtin_parity(p_addr & g_mem_layout.h_fns.lst[i]) !=
-		    ((d_addr.bank >> i) & 1L)) {
-			correct = 0;
-			break;
-		}
-	}
-	if (d_addr.row != ((p_addr &
-			    g_mem_layout.row_mask) >>
-			   __builtin_ctzl(g_mem_layout.row_mask)))
-		correct = 0;
-	if (!correct)
-		fprintf(stderr,
-			"[DEBUG] - Mapping function for 0x%lx not respected\n",
-			p_addr);
+/**
+Inputs: d_lst - DRAM addresses
+        p_lst - output, len entries
+        len - number of addresses
+        mem - the buffer the addresses belong to
 
-#endif
+Batch version of dram_2_phys().
 
-	return p_addr;
+Output: none
+*/
+void dram_2_phys_batch(DRAMAddr *d_lst, physaddr_t *p_lst, size_t len, MemoryBuffer *mem)
+{
+	physaddr_t p_page = mem->xlate.p_base & ~(((uint64_t) PAGE_SIZE - 1));
+	xlate_inv_batch(&g_xlate, d_lst, p_lst, len);
+	for (size_t i = 0; i < len; i++)
+		p_lst[i] |= p_page;
 }
 
 void set_global_dram_layout(DRAMLayout & mem_layout)
@@ -100,6 +97,48 @@ DRAMLayout *get_dram_layout()
 	return &g_mem_layout;
 }
 
+/**
+Inputs: f_name - layout file written by drama (a DRAMLayout, as g_mem_dump.bin)
+
+Replaces the g_mem_layout compiled in main.c. Must run before
+init_dram_xlate().
+
+Output: none
+*/
+void load_dram_layout(const char *f_name)
+{
+	DRAMLayout layout;
+	FILE *fp = fopen(f_name, "rb");
+	if (fp == NULL) {
+		perror("[ERROR] - Unable to open the layout file");
+		exit(1);
+	}
+	size_t res = fread(&layout, sizeof(DRAMLayout), 1, fp);
+	fclose(fp);
+	if (res != 1 || layout.h_fns.len == 0 || layout.h_fns.len > HASH_FN_CNT
+	    || layout.row_mask == 0) {
+		fprintf(stderr, "[ERROR] - %s is not a DRAMLayout\n", f_name);
+		exit(1);
+	}
+	g_mem_layout = layout;
+	fprintf(stderr, "[LOG] - Layout: %s", dramLayout_2_str(&g_mem_layout));
+}
+
+/**
+Inputs: f_name - where to write the layout
+        layout - layout to write
+
+Output: 0 on success, -1 otherwise
+*/
+int save_dram_layout(const char *f_name, DRAMLayout * layout)
+{
+	FILE *fp = fopen(f_name, "wb");
+	if (fp == NULL)
+		return -1;
+	int res = fwrite(layout, sizeof(DRAMLayout), 1, fp) == 1 ? 0 : -1;
+	return fclose(fp) ? -1 : res;
+}
+
 bool d_addr_eq(DRAMAddr * d1, DRAMAddr * d2)
 {
 	return (d1->bank == d2->bank) && (d1->row == d2->row)
@@ -0,0 +1,454 @@
+#include "dram-xlate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define XL_MAX_ERRORS	8	// failures printed by the self-test
+#define XL_BLOCK	256	// addresses per block in the batch calls
+
+/*
+ Reference bit scatter/gather. Only used to build the tables and to
+ check the compiled translator.
+ */
+static uint64_t pext_ref(uint64_t val, uint64_t mask)
+{
+	uint64_t res = 0;
+	for (int bit = 0; mask; mask &= mask - 1, bit++) {
+		res |= ((val >> __builtin_ctzl(mask)) & 1) << bit;
+	}
+	return res;
+}
+
+static uint64_t pdep_ref(uint64_t val, uint64_t mask)
+{
+	uint64_t res = 0;
+	for (int bit = 0; mask; mask &= mask - 1, bit++) {
+		res |= ((val >> bit) & 1) << __builtin_ctzl(mask);
+	}
+	return res;
+}
+
+static void bf_compile(BitField * bf, uint64_t mask)
+{
+	memset(bf, 0x00, sizeof(BitField));
+	bf->mask = mask;
+	bf->bits = __builtin_popcountl(mask);
+	if (mask) {
+		bf->lo = __builtin_ctzl(mask) / 8;
+		bf->hi = (63 - __builtin_clzl(mask)) / 8 + 1;
+	}
+	for (int i = 0; i < XL_BYTES; i++) {
+		for (uint64_t v = 0; v < 256; v++) {
+			bf->gather[i][v] = pext_ref(v << (8 * i), mask);
+			bf->scatter[i][v] = pdep_ref(v << (8 * i), mask);
+		}
+	}
+}
+
+static inline uint64_t bf_gather(BitField * bf, uint64_t val)
+{
+	uint64_t res = 0;
+	for (int i = bf->lo; i < bf->hi; i++) {
+		res |= bf->gather[i][(val >> (8 * i)) & 0xff];
+	}
+	return res;
+}
+
+static inline uint64_t bf_scatter(BitField * bf, uint64_t val)
+{
+	uint64_t res = 0;
+	for (int i = 0; i < (bf->bits + 7) / 8; i++) {
+		res |= bf->scatter[i][(val >> (8 * i)) & 0xff];
+	}
+	return res;
+}
+
+static inline uint64_t bank_bits(DRAMXlate * xl, physaddr_t p_addr)
+{
+	uint64_t bank = 0;
+	for (uint64_t i = 0; i < xl->len; i++) {
+		bank |= (uint64_t) __builtin_parityl(p_addr & xl->fns[i]) << i;
+	}
+	return bank;
+}
+
+/*
+ Gaussian elimination over the physical bits that belong to a bank
+ function but not to the row or the column. For every bank bit i find a
+ combination of those bits that flips bank bit i only. Candidates are
+ taken lowest bit first, so layouts with one private bit per function
+ resolve to that bit.
+ */
+static int solve_bank_fix(DRAMXlate * xl)
+{
+	uint64_t sig[HASH_FN_CNT];
+	physaddr_t vec[HASH_FN_CNT];
+	bool have[HASH_FN_CNT] = { false };
+	uint64_t cand = 0;
+
+	for (uint64_t i = 0; i < xl->len; i++)
+		cand |= xl->fns[i];
+	cand &= ~(xl->row.mask | xl->col.mask);
+
+	for (; cand; cand &= cand - 1) {
+		physaddr_t v = 1ULL << __builtin_ctzl(cand);
+		uint64_t s = bank_bits(xl, v);
+		for (uint64_t k = 0; k < xl->len && s; k++) {
+			if (!((s >> k) & 1))
+				continue;
+			if (!have[k]) {
+				have[k] = true;
+				sig[k] = s;
+				vec[k] = v;
+				break;
+			}
+			s ^= sig[k];
+			v ^= vec[k];
+		}
+	}
+
+	for (uint64_t k = 0; k < xl->len; k++) {
+		if (!have[k])
+			return -1;
+	}
+	// back substitution: sig[k] = 1 << k
+	for (int k = xl->len - 1; k >= 0; k--) {
+		for (uint64_t j = k + 1; j < xl->len; j++) {
+			if ((sig[k] >> j) & 1) {
+				sig[k] ^= sig[j];
+				vec[k] ^= vec[j];
+			}
+		}
+	}
+
+	for (uint64_t b = 0; b < (1ULL << xl->len); b++) {
+		xl->bank_fix[b] = 0;
+		for (uint64_t k = 0; k < xl->len; k++) {
+			if ((b >> k) & 1)
+				xl->bank_fix[b] ^= vec[k];
+		}
+	}
+	return 0;
+}
+
+/**
+Inputs: xl - the translator to fill
+        layout - the DRAM mapping functions
+
+Precompute the forward and inverse mapping of layout.
+
+Output: 0 on success, -1 if the bank functions can't be satisfied without touching row/col bits
+*/
+int xlate_compile(DRAMXlate * xl, DRAMLayout * layout)
+{
+	memset(xl, 0x00, sizeof(DRAMXlate));
+	if (layout->h_fns.len > HASH_FN_CNT || (layout->row_mask & layout->col_mask))
+		return -1;
+
+	xl->len = layout->h_fns.len;
+	for (uint64_t i = 0; i < xl->len; i++)
+		xl->fns[i] = layout->h_fns.lst[i];
+	bf_compile(&xl->row, layout->row_mask);
+	bf_compile(&xl->col, layout->col_mask);
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	xl->bmi2 = __builtin_cpu_supports("bmi2");
+	xl->avx2 = __builtin_cpu_supports("avx2");
+#endif
+	return solve_bank_fix(xl);
+}
+
+#if defined(__x86_64__)
+__attribute__ ((target("bmi2")))
+static DRAMAddr xlate_fwd_bmi2(DRAMXlate * xl, physaddr_t p_addr)
+{
+	DRAMAddr res;
+	res.bank = bank_bits(xl, p_addr);
+	res.row = _pext_u64(p_addr, xl->row.mask);
+	res.col = _pext_u64(p_addr, xl->col.mask);
+	return res;
+}
+
+__attribute__ ((target("bmi2")))
+static physaddr_t xlate_inv_bmi2(DRAMXlate * xl, DRAMAddr d_addr)
+{
+	physaddr_t p_addr = _pdep_u64(d_addr.row, xl->row.mask) |
+	    _pdep_u64(d_addr.col, xl->col.mask);
+	uint64_t diff = (bank_bits(xl, p_addr) ^ d_addr.bank) & ((1ULL << xl->len) - 1);
+	return p_addr ^ xl->bank_fix[diff];
+}
+#endif
+
+DRAMAddr xlate_fwd(DRAMXlate * xl, physaddr_t p_addr)
+{
+#if defined(__x86_64__)
+	if (xl->bmi2)
+		return xlate_fwd_bmi2(xl, p_addr);
+#endif
+	DRAMAddr res;
+	res.bank = bank_bits(xl, p_addr);
+	res.row = bf_gather(&xl->row, p_addr);
+	res.col = bf_gather(&xl->col, p_addr);
+	return res;
+}
+
+physaddr_t xlate_inv(DRAMXlate * xl, DRAMAddr d_addr)
+{
+#if defined(__x86_64__)
+	if (xl->bmi2)
+		return xlate_inv_bmi2(xl, d_addr);
+#endif
+	physaddr_t p_addr = bf_scatter(&xl->row, d_addr.row) |
+	    bf_scatter(&xl->col, d_addr.col);
+	uint64_t diff = (bank_bits(xl, p_addr) ^ d_addr.bank) & ((1ULL << xl->len) - 1);
+	return p_addr ^ xl->bank_fix[diff];
+}
+
+/*
+ Bank bits of len addresses. With AVX2 four addresses are masked with
+ every function at once and the parity of each 64-bit lane is folded down
+ with shifts, the rest falls back to bank_bits().
+ */
+#if defined(__x86_64__)
+__attribute__ ((target("avx2")))
+static size_t bank_bits_avx2(DRAMXlate * xl, physaddr_t * p_lst, uint64_t * bank,
+			     size_t len)
+{
+	__m256i fns[HASH_FN_CNT];
+	__m256i one = _mm256_set1_epi64x(1);
+	for (uint64_t f = 0; f < xl->len; f++)
+		fns[f] = _mm256_set1_epi64x(xl->fns[f]);
+
+	size_t i = 0;
+	for (; i + 4 <= len; i += 4) {
+		__m256i p_addr = _mm256_loadu_si256((__m256i *) & p_lst[i]);
+		__m256i res = _mm256_setzero_si256();
+		for (uint64_t f = 0; f < xl->len; f++) {
+			__m256i v = _mm256_and_si256(p_addr, fns[f]);
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 32));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 16));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 8));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 4));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 2));
+			v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 1));
+			v = _mm256_and_si256(v, one);
+			res = _mm256_or_si256(res, _mm256_sll_epi64(v, _mm_cvtsi64_si128(f)));
+		}
+		_mm256_storeu_si256((__m256i *) & bank[i], res);
+	}
+	return i;
+}
+#endif
+
+static void bank_bits_batch(DRAMXlate * xl, physaddr_t * p_lst, uint64_t * bank,
+			    size_t len)
+{
+	size_t i = 0;
+#if defined(__x86_64__)
+	if (xl->avx2)
+		i = bank_bits_avx2(xl, p_lst, bank, len);
+#endif
+	for (; i < len; i++)
+		bank[i] = bank_bits(xl, p_lst[i]);
+}
+
+#if defined(__x86_64__)
+__attribute__ ((target("bmi2")))
+static void row_col_bmi2(DRAMXlate * xl, physaddr_t * p_lst, DRAMAddr * d_lst,
+			 size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		d_lst[i].row = _pext_u64(p_lst[i], xl->row.mask);
+		d_lst[i].col = _pext_u64(p_lst[i], xl->col.mask);
+	}
+}
+
+__attribute__ ((target("bmi2")))
+static void scatter_bmi2(DRAMXlate * xl, DRAMAddr * d_lst, physaddr_t * p_lst,
+			 size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		p_lst[i] = _pdep_u64(d_lst[i].row, xl->row.mask) |
+		    _pdep_u64(d_lst[i].col, xl->col.mask);
+	}
+}
+#endif
+
+/**
+Inputs: xl - a compiled translator
+        p_lst - physical addresses
+        d_lst - output, len entries
+        len - number of addresses
+
+Same as xlate_fwd() for every entry of p_lst.
+
+Output: none
+*/
+void xlate_fwd_batch(DRAMXlate * xl, physaddr_t * p_lst, DRAMAddr * d_lst, size_t len)
+{
+	uint64_t bank[XL_BLOCK];
+
+	for (size_t off = 0; off < len; off += XL_BLOCK) {
+		size_t n = len - off < XL_BLOCK ? len - off : XL_BLOCK;
+		physaddr_t *p_blk = p_lst + off;
+		DRAMAddr *d_blk = d_lst + off;
+
+		bank_bits_batch(xl, p_blk, bank, n);
+		for (size_t i = 0; i < n; i++)
+			d_blk[i].bank = bank[i];
+#if defined(__x86_64__)
+		if (xl->bmi2) {
+			row_col_bmi2(xl, p_blk, d_blk, n);
+			continue;
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			d_blk[i].row = bf_gather(&xl->row, p_blk[i]);
+			d_blk[i].col = bf_gather(&xl->col, p_blk[i]);
+		}
+	}
+}
+
+/**
+Inputs: xl - a compiled translator
+        d_lst - DRAM addresses
+        p_lst - output, len entries
+        len - number of addresses
+
+Same as xlate_inv() for every entry of d_lst.
+
+Output: none
+*/
+void xlate_inv_batch(DRAMXlate * xl, DRAMAddr * d_lst, physaddr_t * p_lst, size_t len)
+{
+	uint64_t bank[XL_BLOCK];
+	uint64_t b_mask = (1ULL << xl->len) - 1;
+
+	for (size_t off = 0; off < len; off += XL_BLOCK) {
+		size_t n = len - off < XL_BLOCK ? len - off : XL_BLOCK;
+		physaddr_t *p_blk = p_lst + off;
+		DRAMAddr *d_blk = d_lst + off;
+
+#if defined(__x86_64__)
+		if (xl->bmi2)
+			scatter_bmi2(xl, d_blk, p_blk, n);
+		else
+#endif
+		for (size_t i = 0; i < n; i++) {
+			p_blk[i] = bf_scatter(&xl->row, d_blk[i].row) |
+			    bf_scatter(&xl->col, d_blk[i].col);
+		}
+
+		bank_bits_batch(xl, p_blk, bank, n);
+		for (size_t i = 0; i < n; i++)
+			p_blk[i] ^= xl->bank_fix[(bank[i] ^ d_blk[i].bank) & b_mask];
+	}
+}
+
+static uint64_t xorshift(uint64_t * s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+static int check_one(DRAMXlate * xl, DRAMLayout * layout, physaddr_t p_addr,
+		     DRAMAddr d_addr, uint64_t covered, bool square)
+{
+	DRAMAddr ref = {
+		.bank = bank_bits(xl, p_addr),
+		.row = pext_ref(p_addr, layout->row_mask),
+		.col = pext_ref(p_addr, layout->col_mask)
+	};
+	DRAMAddr got = xlate_fwd(xl, p_addr);
+	if (!d_addr_eq(&ref, &got)) {
+		fprintf(stderr, "[ XL ] - fwd(0x%lx) = %s", p_addr, dram_2_str(&got));
+		fprintf(stderr, ", expected %s\n", dram_2_str(&ref));
+		return 1;
+	}
+	if (square && xlate_inv(xl, got) != p_addr) {
+		fprintf(stderr, "[ XL ] - inv(fwd(0x%lx)) = 0x%lx\n", p_addr,
+			xlate_inv(xl, got));
+		return 1;
+	}
+
+	physaddr_t p_inv = xlate_inv(xl, d_addr);
+	got = xlate_fwd(xl, p_inv);
+	if (!d_addr_eq(&d_addr, &got) || (p_inv & ~covered)) {
+		fprintf(stderr, "[ XL ] - inv(%s) = 0x%lx", dram_2_str(&d_addr), p_inv);
+		fprintf(stderr, " maps back to %s\n", dram_2_str(&got));
+		return 1;
+	}
+	return 0;
+}
+
+// batch calls must agree with the scalar ones, including the non-SIMD tail
+static int check_batch(DRAMXlate * xl, uint64_t covered)
+{
+	const size_t len = XL_BLOCK + 3;
+	physaddr_t p_lst[len], p_inv[len];
+	DRAMAddr d_lst[len];
+	uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+	for (size_t i = 0; i < len; i++)
+		p_lst[i] = xorshift(&seed) & covered;
+	xlate_fwd_batch(xl, p_lst, d_lst, len);
+	xlate_inv_batch(xl, d_lst, p_inv, len);
+	for (size_t i = 0; i < len; i++) {
+		DRAMAddr d_addr = xlate_fwd(xl, p_lst[i]);
+		if (!d_addr_eq(&d_addr, &d_lst[i]) || p_inv[i] != xlate_inv(xl, d_addr)) {
+			fprintf(stderr, "[ XL ] - batch mismatch for 0x%lx\n", p_lst[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+Inputs: xl - a compiled translator
+        layout - the layout it was compiled from
+        samples - number of random addresses to check
+
+Check the compiled translator against the plain bitwise definition of layout, in
+both directions. With BMI2 both the PEXT/PDEP and the table path are checked, and
+the batch calls are checked against the scalar ones.
+Meant to run once at startup instead of verifying every translation.
+
+Output: number of failed checks
+*/
+int xlate_self_test(DRAMXlate * xl, DRAMLayout * layout, size_t samples)
+{
+	uint64_t covered = layout->row_mask | layout->col_mask;
+	for (uint64_t i = 0; i < xl->len; i++)
+		covered |= xl->fns[i];
+	bool square = __builtin_popcountl(covered) ==
+	    xl->len + xl->row.bits + xl->col.bits;
+
+	bool bmi2 = xl->bmi2;
+	int errors = 0;
+	for (int pass = 0; pass < (bmi2 ? 2 : 1); pass++) {
+		uint64_t seed = 0x9e3779b97f4a7c15ULL;
+		xl->bmi2 = bmi2 && pass == 0;
+		for (size_t i = 0; i < samples && errors < XL_MAX_ERRORS; i++) {
+			physaddr_t p_addr = xorshift(&seed) & covered;
+			DRAMAddr d_addr = {
+				.bank = xorshift(&seed) & ((1ULL << xl->len) - 1),
+				.row = xorshift(&seed) & LS_BITMASK(xl->row.bits),
+				.col = xorshift(&seed) & LS_BITMASK(xl->col.bits)
+			};
+			errors += check_one(xl, layout, p_addr, d_addr, covered, square);
+		}
+		errors += check_batch(xl, covered);
+	}
+	xl->bmi2 = bmi2;
+	return errors;
+}
@@ -0,0 +1,279 @@
+#include "fliptable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "utils.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+static void write_all(FlipTable * ft, const void *data, size_t len)
+{
+	const char *ptr = (const char *)data;
+	while (len) {
+		ssize_t res = write(ft->fd, ptr, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("[ERROR] - Unable to write the fliptable");
+			exit(1);
+		}
+		ptr += res;
+		len -= res;
+		ft->bytes += res;
+	}
+	ft->writes++;
+}
+
+FlipTable *ft_open(const char *f_name, DRAMLayout * layout, uint64_t seed,
+		   SessionConfig * cfg)
+{
+	FlipTable *ft = (FlipTable *) calloc(1, sizeof(FlipTable));
+	assert(ft != NULL);
+	ft->fd = open(f_name, O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+	if (ft->fd < 0) {
+		perror("[ERROR] - Unable to open the fliptable");
+		exit(1);
+	}
+	ft->buf = (FTRecord *) malloc(sizeof(FTRecord) * FT_BUF_RECS);
+	assert(ft->buf != NULL);
+
+	FTHeader hdr;
+	memset(&hdr, 0x00, sizeof(FTHeader));
+	strncpy(hdr.magic, FT_MAGIC, sizeof(hdr.magic));
+	hdr.version = FT_VERSION;
+	hdr.rec_size = sizeof(FTRecord);
+	hdr.layout = *layout;
+	hdr.seed = seed;
+	hdr.cfg = *cfg;
+	write_all(ft, &hdr, sizeof(FTHeader));
+	ft->t_flush = realtime_now();
+	return ft;
+}
+
+/**
+Inputs: f_name - fliptable of an interrupted session
+        off - bytes of the file to keep, see Checkpoint
+
+Reopens a fliptable for appending, dropping what was written after off.
+
+Output: the FlipTable, exits if f_name isn't a fliptable
+*/
+FlipTable *ft_resume(const char *f_name, uint64_t off)
+{
+	FlipTable *ft = (FlipTable *) calloc(1, sizeof(FlipTable));
+	assert(ft != NULL);
+	ft->fd = open(f_name, O_RDWR | O_APPEND);
+	if (ft->fd < 0) {
+		perror("[ERROR] - Unable to open the fliptable");
+		exit(1);
+	}
+	FTHeader hdr;
+	if (pread(ft->fd, &hdr, sizeof(FTHeader), 0) != sizeof(FTHeader)
+	    || strncmp(hdr.magic, FT_MAGIC, sizeof(hdr.magic)) || hdr.version != FT_VERSION
+	    || off < sizeof(FTHeader) || (off - sizeof(FTHeader)) % sizeof(FTRecord)) {
+		fprintf(stderr, "[ERROR] - Unable to resume %s\n", f_name);
+		exit(1);
+	}
+	if (ftruncate(ft->fd, off)) {
+		perror("[ERROR] - Unable to truncate the fliptable");
+		exit(1);
+	}
+	ft->buf = (FTRecord *) malloc(sizeof(FTRecord) * FT_BUF_RECS);
+	assert(ft->buf != NULL);
+	ft->bytes = off;
+	ft->t_flush = realtime_now();
+	return ft;
+}
+
+void ft_flush(FlipTable * ft)
+{
+	if (ft == NULL)
+		return;
+	if (ft->len)
+		write_all(ft, ft->buf, sizeof(FTRecord) * ft->len);
+	ft->len = 0;
+	ft->t_flush = realtime_now();
+}
+
+void ft_push(FlipTable * ft, FTRecord * rec, size_t n)
+{
+	if (ft == NULL)
+		return;
+	while (n) {
+		size_t cnt = FT_BUF_RECS - ft->len < n ? FT_BUF_RECS - ft->len : n;
+		memcpy(&ft->buf[ft->len], rec, sizeof(FTRecord) * cnt);
+		ft->len += cnt;
+		rec += cnt;
+		n -= cnt;
+		if (ft->len == FT_BUF_RECS)
+			ft_flush(ft);
+	}
+}
+
+void ft_close(FlipTable * ft)
+{
+	if (ft == NULL)
+		return;
+	ft_flush(ft);
+	close(ft->fd);
+	free(ft->buf);
+	free(ft);
+}
+
+void ft_buf_push(FTBuffer * buf, FTRecord * rec)
+{
+	if (buf->len == buf->cap) {
+		buf->cap = buf->cap ? buf->cap * 2 : 64;
+		buf->rec = (FTRecord *) realloc(buf->rec, sizeof(FTRecord) * buf->cap);
+		assert(buf->rec != NULL);
+	}
+	buf->rec[buf->len++] = *rec;
+}
+
+/*
+ Text conversion of a single pattern. With FT_TABLE every bank gets a line
+ "aggressors : flips", the lines of banks without flips are rebuilt here.
+ */
+typedef struct {
+	FILE *out;
+	FTRecord *aggrs;	// FT_AGGR records of the pattern, for the AggrFreq
+	size_t len;
+	size_t cap;
+	bool table;
+	bool freq;
+	bool open;		// a pattern is being printed
+	uint64_t bk;		// bank of the current line
+	uint64_t bks;
+} FTConv;
+
+static void conv_line(FTConv * conv)
+{
+	for (size_t i = 0; i < conv->len; i++) {
+		FTRecord *a = &conv->aggrs[i];
+		fprintf(conv->out, "r%05u.bk%02lu", a->row, conv->bk);
+		if (conv->freq)
+			fprintf(conv->out, ".f%u.p%04u.a%u", a->val >> 16, a->col, a->val & 0xffff);
+		fprintf(conv->out, "%s", i + 1 != conv->len ? "/" : "");
+	}
+	fprintf(conv->out, " : ");
+}
+
+/* Close the line of the current bank and open the lines up to bank bk. */
+static void conv_goto_bank(FTConv * conv, uint64_t bk)
+{
+	while (conv->bk < bk) {
+		fprintf(conv->out, "\n");
+		conv->bk++;
+		conv_line(conv);
+	}
+}
+
+static void conv_end(FTConv * conv)
+{
+	if (!conv->open)
+		return;
+	if (conv->table) {
+		conv_goto_bank(conv, conv->bks - 1);
+		fprintf(conv->out, "\n");
+	}
+	conv->open = false;
+}
+
+static int conv_record(FTConv * conv, FTRecord * rec, FILE * fp)
+{
+	switch (rec->type) {
+	case FT_PATT:
+		conv_end(conv);
+		if (rec->val > conv->cap) {
+			conv->cap = rec->val;
+			conv->aggrs = (FTRecord *) realloc(conv->aggrs, sizeof(FTRecord) * conv->cap);
+			assert(conv->aggrs != NULL);
+		}
+		conv->len = 0;
+		conv->table = rec->flags & FT_TABLE;
+		conv->freq = rec->flags & FT_FREQ;
+		conv->bk = 0;
+		for (size_t i = 0; i < rec->val; i++) {
+			FTRecord *aggr = &conv->aggrs[conv->len];
+			if (fread(aggr, sizeof(FTRecord), 1, fp) != 1 || aggr->type != FT_AGGR)
+				return -1;
+			conv->len++;
+		}
+		conv->open = true;
+		if (conv->table)
+			conv_line(conv);
+		return 0;
+	case FT_FLIP:
+		if (!conv->open || rec->bank < conv->bk || rec->bank >= conv->bks)
+			return -1;
+		if (conv->table)
+			conv_goto_bank(conv, rec->bank);
+		fprintf(conv->out, "%02x,%02x,r%05u.bk%02u.col%04u ", rec->f_og, rec->f_new,
+			rec->row, rec->bank, rec->col);
+		return 0;
+	case FT_FIRST:		// not in the text format
+	case FT_TIME:
+		return conv->open && rec->bank < conv->bks ? 0 : -1;
+	default:
+		return -1;
+	}
+}
+
+/**
+Inputs: f_name - binary fliptable
+        out - where to write the text fliptable
+
+Converts a binary fliptable to the text format read by py/hammertime.
+
+Output: 0 on success, -1 on a malformed file
+*/
+int ft_convert(const char *f_name, FILE * out)
+{
+	FILE *fp = fopen(f_name, "rb");
+	if (fp == NULL) {
+		perror("[ERROR] - Unable to open the fliptable");
+		return -1;
+	}
+
+	FTHeader hdr;
+	if (fread(&hdr, sizeof(FTHeader), 1, fp) != 1 || strncmp(hdr.magic, FT_MAGIC, sizeof(hdr.magic))
+	    || hdr.version != FT_VERSION || hdr.rec_size != sizeof(FTRecord)) {
+		fprintf(stderr, "[ERROR] - %s is not a version %d fliptable\n", f_name, FT_VERSION);
+		fclose(fp);
+		return -1;
+	}
+	fprintf(stderr, "[LOG] - %s seed: %lx, layout: %s", f_name, hdr.seed, dramLayout_2_str(&hdr.layout));
+
+	FTConv conv;
+	memset(&conv, 0x00, sizeof(FTConv));
+	conv.out = out;
+	conv.bks = 1ULL << hdr.layout.h_fns.len;
+
+	FTRecord rec;
+	int res = 0;
+	size_t cnt = 0;
+	while (fread(&rec, sizeof(FTRecord), 1, fp) == 1) {
+		if (conv_record(&conv, &rec, fp)) {
+			fprintf(stderr, "[ERROR] - Malformed record %ld\n", cnt);
+			res = -1;
+			break;
+		}
+		cnt++;
+	}
+	conv_end(&conv);
+	fflush(out);
+
+	free(conv.aggrs);
+	fclose(fp);
+	return res;
+}
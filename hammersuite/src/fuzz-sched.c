@@ -0,0 +1,198 @@
+#include "fuzz-sched.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define FZ_HALF		(FZ_BITS / 2)
+#define FZ_MASK		((1UL << FZ_HALF) - 1)
+
+static uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t fz_rand(FuzzSched * fz)
+{
+	return mix64(fz->rng += 0x9e3779b97f4a7c15ULL);
+}
+
+/* Balanced Feistel network, a bijection over [0, 2^FZ_BITS). */
+static uint64_t feistel(uint64_t key, uint64_t x)
+{
+	uint64_t l = x >> FZ_HALF;
+	uint64_t r = x & FZ_MASK;
+	for (int i = 0; i < FZ_ROUNDS; i++) {
+		uint64_t tmp = r;
+		r = l ^ (mix64(key + i * 0x9e3779b97f4a7c15ULL + r) & FZ_MASK);
+		l = tmp;
+	}
+	return (l << FZ_HALF) | r;
+}
+
+/* Cycle walking restricts the permutation to [0, FZ_TUPLES). */
+static uint64_t permute(uint64_t key, uint64_t idx)
+{
+	uint64_t x = idx;
+	do {
+		x = feistel(key, x);
+	} while (x >= FZ_TUPLES);
+	return x;
+}
+
+static void decode(uint64_t x, FuzzTuple * t)
+{
+	t->offset = FZ_OFF_MIN + x % (FZ_OFF_MAX - FZ_OFF_MIN);
+	x /= FZ_OFF_MAX - FZ_OFF_MIN;
+	t->v = FZ_V_MIN + x % (FZ_V_MAX - FZ_V_MIN);
+	x /= FZ_V_MAX - FZ_V_MIN;
+	t->d = FZ_D_MIN + x % (FZ_D_MAX - FZ_D_MIN);
+	x /= FZ_D_MAX - FZ_D_MIN;
+	t->aggr_n = FZ_AGGR_MIN + x;
+}
+
+static uint64_t encode(FuzzTuple * t)
+{
+	uint64_t x = t->aggr_n - FZ_AGGR_MIN;
+	x = x * (FZ_D_MAX - FZ_D_MIN) + t->d - FZ_D_MIN;
+	x = x * (FZ_V_MAX - FZ_V_MIN) + t->v - FZ_V_MIN;
+	x = x * (FZ_OFF_MAX - FZ_OFF_MIN) + t->offset - FZ_OFF_MIN;
+	return x;
+}
+
+static bool mark(FuzzSched * fz, uint64_t x)
+{
+	if (fz->bits[x / 64] & (1ULL << (x % 64)))
+		return false;
+	fz->bits[x / 64] |= 1ULL << (x % 64);
+	fz->tested++;
+	return true;
+}
+
+/* Next untested tuple of the current pass. */
+static void next_untested(FuzzSched * fz, FuzzTuple * t)
+{
+	if (fz->tested == FZ_TUPLES) {
+		fprintf(stderr, "[LOG] - All %d fuzzing tuples tested (pass %ld)\n", FZ_TUPLES, fz->pass);
+		memset(fz->bits, 0x00, sizeof(fz->bits));
+		fz->tested = 0;
+		fz->idx = 0;
+		fz->pass++;
+	}
+
+	uint64_t key = mix64(fz->seed + fz->pass);
+	uint64_t x;
+	do {
+		// the permutation covers the pass, idx can't run past it
+		x = permute(key, fz->idx++ % FZ_TUPLES);
+	} while (!mark(fz, x));
+	decode(x, t);
+}
+
+static double arm_rate(FuzzArm * arm)
+{
+	return arm->ns ? arm->flips * 1e9 / arm->ns : 0;
+}
+
+/* UCB1 pick over n arms, ties go to a random arm. */
+static int ucb_arm(FuzzSched * fz, FuzzArm * arm, int n)
+{
+	double best = 0;
+	for (int i = 0; i < n; i++)
+		best = arm_rate(&arm[i]) > best ? arm_rate(&arm[i]) : best;
+
+	int start = fz_rand(fz) % n;
+	int pick = start;
+	double top = -1;
+	for (int k = 0; k < n; k++) {
+		int i = (start + k) % n;
+		if (!arm[i].pulls)
+			return i;	// every arm is tried once first
+		double score = (best > 0 ? arm_rate(&arm[i]) / best : 0)
+		    + FZ_UCB_C * sqrt(log((double)fz->bd.pulls) / arm[i].pulls);
+		if (score > top) {
+			top = score;
+			pick = i;
+		}
+	}
+	return pick;
+}
+
+/**
+Inputs: fz - scheduler state
+        seed - seed of the permutation and of the bandit
+        bandit - pick tuples with the bandit instead of the uniform walk
+
+Output: none
+*/
+void fz_init(FuzzSched * fz, uint64_t seed, int bandit)
+{
+	memset(fz, 0x00, sizeof(FuzzSched));
+	fz->seed = seed;
+	fz->rng = mix64(seed);
+	fz->bandit = bandit;
+}
+
+/**
+Inputs: fz - scheduler state
+        t - where to store the next tuple
+
+Returns the next untested tuple of the current pass, starting a new pass
+after full coverage. With fz->bandit that's only the case for FZ_EXPLORE
+of the picks, the others take the best arm of each dimension and a random
+offset.
+
+Output: none
+*/
+void fz_next(FuzzSched * fz, FuzzTuple * t)
+{
+	if (!fz->bandit || (fz_rand(fz) >> 11) * 0x1.0p-53 < FZ_EXPLORE) {
+		fz->bd.explore++;
+		next_untested(fz, t);
+		return;
+	}
+
+	t->aggr_n = FZ_AGGR_MIN + ucb_arm(fz, fz->bd.aggr, FZ_AGGR_MAX - FZ_AGGR_MIN);
+	t->d = FZ_D_MIN + ucb_arm(fz, fz->bd.d, FZ_D_MAX - FZ_D_MIN);
+	t->v = FZ_V_MIN + ucb_arm(fz, fz->bd.v, FZ_V_MAX - FZ_V_MIN);
+	t->offset = FZ_OFF_MIN + fz_rand(fz) % (FZ_OFF_MAX - FZ_OFF_MIN);
+	if (fz->tested < FZ_TUPLES)
+		mark(fz, encode(t));
+}
+
+static void arm_reward(FuzzArm * arm, uint64_t flips, uint64_t ns)
+{
+	arm->pulls++;
+	arm->flips += flips;
+	arm->ns += ns;
+}
+
+/* Reward the arms of t with the flips it caused in ns. */
+void fz_reward(FuzzSched * fz, FuzzTuple * t, uint64_t flips, uint64_t ns)
+{
+	arm_reward(&fz->bd.aggr[t->aggr_n - FZ_AGGR_MIN], flips, ns);
+	arm_reward(&fz->bd.d[t->d - FZ_D_MIN], flips, ns);
+	arm_reward(&fz->bd.v[t->v - FZ_V_MIN], flips, ns);
+	fz->bd.pulls++;
+}
+
+static void report_arms(const char *name, FuzzArm * arm, int n, int min)
+{
+	fprintf(stderr, "[STAT] - %s (pulls/flips):", name);
+	for (int i = 0; i < n; i++)
+		fprintf(stderr, " %d:%ld/%ld", min + i, arm[i].pulls, arm[i].flips);
+	fprintf(stderr, "\n");
+}
+
+void fz_report(FuzzSched * fz)
+{
+	fprintf(stderr, "[STAT] - tuples: %ld/%d tested (pass %ld), %ld uniform picks of %ld\n",
+		fz->tested, FZ_TUPLES, fz->pass, fz->bd.explore, fz->bd.pulls);
+	if (!fz->bandit)
+		return;
+	report_arms("aggr_n", fz->bd.aggr, FZ_AGGR_MAX - FZ_AGGR_MIN, FZ_AGGR_MIN);
+	report_arms("d", fz->bd.d, FZ_D_MAX - FZ_D_MIN, FZ_D_MIN);
+	report_arms("v", fz->bd.v, FZ_V_MAX - FZ_V_MIN, FZ_V_MIN);
+}
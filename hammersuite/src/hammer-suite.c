@@ -6,6 +6,11 @@
 #include "include/dram-address.h"
 #include "include/addr-mapper.h"
 #include "include/params.h"
+#include "include/fliptable.h"
+#include "include/writer.h"
+#include "include/checkpoint.h"
+#include "include/jit.h"
+#include "include/refresh.h"
 
 #include <assert.h>
 #include <sys/types.h>
@@ -22,6 +27,8 @@
 #include <sched.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 
 #ifdef NUC
 #include "utils-intel.h"
@@ -38,6 +45,23 @@
 #define P_FIELD			1<<3
 #define ALL_FIELDS		(ROW_FIELD | COL_FIELD | BK_FIELD)
 #define FLIPTABLE
+#ifdef FLIPTABLE
+#define OUT_EXT ".ft"		// binary, see tester --convert
+#else
+#define OUT_EXT ".csv"
+#endif
+#define PATT_STR_LEN		1024	// hPatt_2_str() buffer
+#define STATS_EVERY		100	// patterns between [STAT] lines when fuzzing
+#define FREQ_PERIOD		1024	// slots of a frequency-domain pattern
+#define FREQ_MAX_LOG	3		// up to 8 occurrences per period
+#define FREQ_MAX_AMP	3
+#define FREQ_IDLE_SPINS	200		// spin() iterations of an empty slot, about an access to a flushed row
+#define SLOT_FENCE		(1U << 31)	// sched entry: the row comes again later in the period
+#define SLOT_IDLE		(1U << 30)	// sched entry: run of empty slots
+#define SLOT_ARG		(SLOT_IDLE - 1)	// aggressor index or empty slots
+#define SCAN_BATCH		8	// rows flushed with a single fence before the compare
+#define TREFW_NS		64000000UL	// refresh window, see --auto-rounds
+#define CALIB_ITERS		1024	// hammer loop iterations timed by calibrate_rounds()
 
 /*
  h_patt		= hammer pattern (e.g., DOUBLE_SIDED)
@@ -63,15 +87,23 @@
 #define NOP1000 NOP100 NOP100 NOP100 NOP100 NOP100 NOP100 NOP100 NOP100 NOP100 NOP100
 
 extern ProfileParams *p;
+extern uint64_t g_t_start;
 
 int g_bk;
 FILE *out_fd            = NULL;
+FlipTable *g_ft         = NULL;
+static __thread FTBuffer *t_ft_buf = NULL;	// per-bank records of a pool worker
 static uint64_t CL_SEED = 0x7bc661612e71168c;
 
 typedef struct {
 	DRAMAddr *d_lst;
 	size_t len;
 	size_t rounds;
+	AggrFreq *f_lst;	// NULL hammers every aggressor once per round
+	uint32_t *sched;	// f_lst expanded by expand_pattern(), indices in d_lst
+	size_t sched_len;
+	size_t sched_acts;	// accesses of sched, empty slots excluded
+	JitFn kernel;		// compiled by jit_pattern(), NULL runs the loop of hammer_it()
 } HammerPattern;
 
 typedef struct {
@@ -81,18 +113,81 @@ typedef struct {
 	HammerPattern *h_patt;
 } FlipVal;
 
+/*
+ Aggressor virtual addresses of a HammerPattern for every bank, resolved
+ once through the ADDRMapper. The aggressors of bank bk are stored at
+ v_lst[bk * len ... bk * len + len - 1]. The array is cache-aligned and only
+ grows, so resolving a new pattern does not allocate in the steady state.
+ */
+typedef struct {
+	char **v_lst;
+	size_t len;		// aggressors per bank
+	size_t cap;		// allocated entries
+} ResolvedPattern;
+
+/*
+ Rows to scan after a pattern: the aggressors +- p->vict_win, clipped to the
+ h_rows of the suite and merged into sorted, disjoint [lo, hi) intervals.
+ Rows are relative to mapper->base_row.
+ */
+typedef struct {
+	size_t lo, hi;
+} RowRange;
+
+typedef struct {
+	RowRange *lst;
+	size_t len;
+	size_t cap;
+	bool full;		// this pattern sweeps all h_rows
+} VictimWindow;
+
+typedef struct {
+	uint64_t setup_ns;	// time spent resolving patterns
+	uint64_t setup_cnt;	// resolved patterns
+	uint64_t legacy_ns;	// same pattern through dram_2_phys/phys_2_virt
+	uint64_t legacy_cnt;
+	uint64_t init_ns;	// time spent in init_chunk()
+	uint64_t init_cnt;
+	uint64_t scan_rows;	// rows scanned, all banks
+	uint64_t flips;
+	uint64_t early_cnt;	// banks stopped at the first flip, see hammer_bank()
+	uint64_t early_acts;	// their activations up to the flip
+	uint64_t short_chunks;	// banks with --chunk shorter than TREFW_NS
+	uint64_t dirty_rows;	// rows rewritten by incremental init_chunk()
+	uint64_t calib_ns;	// time spent in calibrate_rounds()
+	uint64_t acts;		// activations, all banks
+	uint64_t act_ns;	// their hammer time
+	uint64_t sync_ns;	// time spent in refresh_sync(), all banks
+	uint64_t sync_miss;	// refresh_sync() timeouts
+	uint64_t rounds;	// hammer rounds, all patterns
+	uint64_t fill_ns;	// pipeline stages, see pool_pipeline()
+	uint64_t hammer_ns;
+	uint64_t scan_ns;
+	uint64_t stage_ns;	// wall clock of the pipelined attacks
+} HammerStats;
+
 typedef struct {
 	MemoryBuffer *mem;
 	SessionConfig *cfg;
 	DRAMAddr d_base;	// base address for hammering
 	ADDRMapper *mapper;	// dram mapper
+	ResolvedPattern r_patt;	// aggressors of the current pattern
+	VictimWindow win;	// victim rows of the current pattern
+	uint64_t *dirty;	// bit bk * h_rows + row: row changed since init_chunk()
+	uint32_t *sched;	// FREQ_PERIOD entries, see expand_pattern()
+	JitKernel jit;		// kernel of the current pattern
+	RefreshDet refresh;	// threshold 0 hammers without refresh_sync()
+	uint64_t setup_off;	// stats.setup_cnt of the runs before --resume
+	uint64_t init_off;	// stats.init_cnt of the runs before --resume
+	struct HammerPool *pool;	// bank workers, see pool_attack()
+	HammerStats stats;
 
 	int (*hammer_test) (void *self);
 } HammerSuite;
 
 char *dAddr_2_str(DRAMAddr d_addr, uint8_t fields)
 {
-	static char ret_str[64];
+	static __thread char ret_str[64];
 	char tmp_str[10];
 	bool first = true;
 	memset(ret_str, 0x00, 64);
@@ -120,54 +215,62 @@ char *dAddr_2_str(DRAMAddr d_addr, uint8_t fields)
 	return ret_str;
 }
 
+// long patterns are cut short with "..."
 char *hPatt_2_str(HammerPattern * h_patt, int fields)
 {
-	static char patt_str[256];
+	static __thread char patt_str[PATT_STR_LEN];
 	char *dAddr_str;
+	size_t len = 0;
 
-	memset(patt_str, 0x00, 256);
+	memset(patt_str, 0x00, PATT_STR_LEN);
 
 	for (int i = 0; i < h_patt->len; i++) {
 		dAddr_str = dAddr_2_str(h_patt->d_lst[i], fields);
+		size_t d_len = strlen(dAddr_str);
+		if (len + d_len + 5 > PATT_STR_LEN) {
+			strcat(patt_str, "...");
+			break;
+		}
 		strcat(patt_str, dAddr_str);
+		len += d_len;
 		if (i + 1 != h_patt->len) {
 			strcat(patt_str, "/");
+			len++;
 		}
 
 	}
 	return patt_str;
 }
 
-void print_start_attack(HammerPattern *h_patt)
-{
-	fprintf(out_fd, "%s : ", hPatt_2_str(h_patt, ROW_FIELD | BK_FIELD));
-	fflush(out_fd);
-}
-
-void print_end_attack()
-{
-	fprintf(out_fd, "\n");
-	fflush(out_fd);
-}
-
 void export_flip(FlipVal * flip)
 {
+#ifdef FLIPTABLE
+	// workers buffer their banks, merged in bank order. The writer thread
+	// prints the verbose [FLIP] lines.
+	FTRecord rec;
+	memset(&rec, 0x00, sizeof(FTRecord));
+	rec.type = FT_FLIP;
+	rec.f_og = flip->f_og;
+	rec.f_new = flip->f_new;
+	rec.bank = flip->d_vict.bank;
+	rec.row = flip->d_vict.row;
+	rec.col = flip->d_vict.col;
+	if (t_ft_buf)
+		ft_buf_push(t_ft_buf, &rec);
+	else
+		out_record(&rec);
+#else
 	if (p->g_flags & F_VERBOSE) {
 		fprintf(stdout, "[FLIP] - (%02x => %02x)\t vict: %s \taggr: %s \n",
 				flip->f_og, flip->f_new, dAddr_2_str(flip->d_vict, ALL_FIELDS),
 				hPatt_2_str(flip->h_patt, ROW_FIELD | BK_FIELD));
 		fflush(stdout);
 	}
-
-#ifdef FLIPTABLE
-		fprintf(out_fd, "%02x,%02x,%s ", flip->f_og, flip->f_new,
-				dAddr_2_str(flip->d_vict, ALL_FIELDS));
-#else
-		fprintf(out_fd, "%02x,%02x,%s,%s\n", flip->f_og, flip->f_new,
-				dAddr_2_str(flip->d_vict, ALL_FIELDS), hPatt_2_str(flip->h_patt,
-					ROW_FIELD | BK_FIELD | P_FIELD));
-#endif
+	fprintf(out_fd, "%02x,%02x,%s,%s\n", flip->f_og, flip->f_new,
+			dAddr_2_str(flip->d_vict, ALL_FIELDS), hPatt_2_str(flip->h_patt,
+				ROW_FIELD | BK_FIELD | P_FIELD));
 	fflush(out_fd);
+#endif
 }
 
 void export_cfg(HammerSuite * suite)
@@ -191,6 +294,23 @@ void export_cfg(HammerSuite * suite)
 	fflush(out_fd);
 }
 
+/* Activations and hammer time of bank bk up to its first flip. */
+void export_first(size_t bk, uint64_t acts, uint64_t ns)
+{
+#ifdef FLIPTABLE
+	FTRecord rec;
+	memset(&rec, 0x00, sizeof(FTRecord));
+	rec.type = FT_FIRST;
+	rec.bank = bk;
+	rec.val = acts < UINT32_MAX ? acts : UINT32_MAX;
+	rec.row = ns / 1000 < UINT32_MAX ? ns / 1000 : UINT32_MAX;
+	if (t_ft_buf)
+		ft_buf_push(t_ft_buf, &rec);
+	else
+		out_record(&rec);
+#endif
+}
+
 void swap(char **lst, int i, int j)
 {
 	char *tmp = lst[i];
@@ -198,46 +318,390 @@ void swap(char **lst, int i, int j)
 	lst[j] = tmp;
 }
 
+static uint64_t fuzz_rng = 0;	// fuzzer PRNG state, saved in the checkpoint
+
+/* splitmix64, unlike rand() its state can be saved and restored. */
+static uint64_t fuzz_next()
+{
+	uint64_t z = (fuzz_rng += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
 int random_int(int min, int max)
 {
-	int number = min + rand() % (max - min);
+	int number = min + fuzz_next() % (max - min);
 	return number;
 }
 
-uint64_t hammer_it(HammerPattern* patt, MemoryBuffer* mem) {
+/*
+ Time the pre-mapper resolution path (one dram_2_phys/phys_2_virt round
+ trip per aggressor and bank) for comparison with resolve_pattern().
+ Only sampled once per session since it is what we are trying to avoid.
+ */
+void sample_legacy_setup(HammerSuite * suite, HammerPattern * patt)
+{
+	uint64_t t0 = realtime_now();
+	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+		for (size_t i = 0; i < patt->len; i++) {
+			DRAMAddr d_tmp = patt->d_lst[i];
+			d_tmp.bank = bk;
+			char *v_addr = phys_2_virt(dram_2_phys(d_tmp, suite->mem), suite->mem);
+			asm volatile (""::"r" (v_addr));
+		}
+	}
+	suite->stats.legacy_ns += ticks_2_ns(realtime_now() - t0);
+	suite->stats.legacy_cnt++;
+}
+
+static int range_cmp(const void *r0, const void *r1)
+{
+	size_t lo0 = ((RowRange *) r0)->lo, lo1 = ((RowRange *) r1)->lo;
+	return (lo0 > lo1) - (lo0 < lo1);
+}
 
-	char** v_lst = (char**) malloc(sizeof(char*)*patt->len);
+/*
+ Build suite->win for patt. Every p->full_scan patterns, or when p->vict_win is
+ 0, the window is the whole h_rows range.
+ */
+void build_victim_window(HammerSuite * suite, HammerPattern * patt)
+{
+	VictimWindow *win = &suite->win;
+	size_t h_rows = suite->cfg->h_rows;
+	size_t base = suite->mapper->base_row;
+
+	win->full = p->vict_win == 0 ||
+	    (p->full_scan && (suite->setup_off + suite->stats.setup_cnt) % p->full_scan == 0);
+	if (patt->len > win->cap) {
+		free(win->lst);
+		win->lst = (RowRange *) malloc(sizeof(RowRange) * patt->len);
+		assert(win->lst != NULL);
+		win->cap = patt->len;
+	}
+	if (win->full) {
+		win->lst[0].lo = 0;
+		win->lst[0].hi = h_rows;
+		win->len = 1;
+		return;
+	}
+
+	size_t n = 0;
 	for (size_t i = 0; i < patt->len; i++) {
-		v_lst[i] = phys_2_virt(dram_2_phys(patt->d_lst[i], mem), mem);
+		size_t row = patt->d_lst[i].row - base;
+		if (row >= h_rows)
+			continue;
+		win->lst[n].lo = row > p->vict_win ? row - p->vict_win : 0;
+		win->lst[n].hi = row + p->vict_win + 1 < h_rows ? row + p->vict_win + 1 : h_rows;
+		n++;
 	}
-	sched_yield_helper();
-	if (p->threshold > 0) {
-		uint64_t t0 = 0, t1 = 0;
-		// Threshold value depends on your system
-		while (abs((int64_t) t1 - (int64_t) t0) < p->threshold) {
-			t0 = rdtscp();
-			*(volatile char *)v_lst[0];
-			clflushopt(v_lst[0]);
-			t1 = rdtscp();
+	qsort(win->lst, n, sizeof(RowRange), range_cmp);
+
+	win->len = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (win->len && win->lst[i].lo <= win->lst[win->len - 1].hi) {
+			RowRange *last = &win->lst[win->len - 1];
+			last->hi = win->lst[i].hi > last->hi ? win->lst[i].hi : last->hi;
+			continue;
 		}
+		win->lst[win->len++] = win->lst[i];
 	}
+}
 
+/*
+ Lay the occurrences of every aggressor of patt on a FREQ_PERIOD timeline,
+ moving collisions to the next free slot, and flatten it into patt->sched.
+ Runs of empty slots become SLOT_IDLE entries, so the phase of an
+ aggressor shifts its accesses in time and not only in order. Accesses of
+ a row that comes again in the period get SLOT_FENCE: clflushopt() isn't
+ ordered with the next load, which would hit the cache without a fence.
+ */
+static void expand_pattern(HammerSuite * suite, HammerPattern * patt)
+{
+	int32_t slot[FREQ_PERIOD];
+	size_t used = 0;
 
-	uint64_t cl0, cl1;
-	cl0 = realtime_now();
-	for ( int i = 0; i < patt->rounds;  i++) {
-		mfence();
-		for (size_t j = 0; j < patt->len; j++) {
-			*(volatile char*) v_lst[j];
+	if (suite->sched == NULL) {
+		suite->sched = (uint32_t *) malloc(sizeof(uint32_t) * FREQ_PERIOD);
+		assert(suite->sched != NULL);
+	}
+	memset(slot, 0xff, sizeof(slot));
+	for (size_t i = 0; i < patt->len; i++) {
+		AggrFreq *f = &patt->f_lst[i];
+		for (size_t k = 0; k < f->freq; k++) {
+			size_t s = f->phase + k * (FREQ_PERIOD / f->freq);
+			for (size_t a = 0; a < f->amp && used < FREQ_PERIOD; a++, used++, s++) {
+				while (slot[s % FREQ_PERIOD] != -1)
+					s++;
+				slot[s % FREQ_PERIOD] = i;
+			}
 		}
+	}
+
+	patt->sched = suite->sched;
+	patt->sched_len = 0;
+	patt->sched_acts = used;
+	for (size_t s = 0; s < FREQ_PERIOD; s++) {
+		uint32_t *last = patt->sched_len ? &patt->sched[patt->sched_len - 1] : NULL;
+		if (slot[s] != -1)
+			patt->sched[patt->sched_len++] = slot[s];
+		else if (last && (*last & SLOT_IDLE))
+			(*last)++;
+		else
+			patt->sched[patt->sched_len++] = SLOT_IDLE | 1;
+	}
+	for (size_t s = 0; s < patt->sched_len; s++) {
+		if (patt->sched[s] & SLOT_IDLE)
+			continue;
+		for (size_t n = s + 1; n < patt->sched_len; n++) {
+			if (patt->sched[n] == (patt->sched[s] & SLOT_ARG)) {
+				patt->sched[s] |= SLOT_FENCE;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ Compile the accesses of one round of patt, the same for every bank. With
+ p->jit_nops every access is followed by that many NOPs.
+ */
+static void jit_pattern(HammerSuite * suite, HammerPattern * patt)
+{
+	JitKernel *k = &suite->jit;
+	jit_reset(k);
+	jit_op(k, JIT_FENCE, 0);
+	if (patt->sched) {
+		for (size_t s = 0; s < patt->sched_len; s++) {
+			uint32_t e = patt->sched[s];
+			if (e & SLOT_IDLE) {
+				for (size_t n = (e & SLOT_ARG) * FREQ_IDLE_SPINS; n;) {
+					size_t spins = n < UINT16_MAX ? n : UINT16_MAX;
+					jit_op(k, JIT_IDLE, spins);
+					n -= spins;
+				}
+				continue;
+			}
+			jit_op(k, JIT_ACCESS, e & SLOT_ARG);
+			if (p->jit_nops)
+				jit_op(k, JIT_NOP, p->jit_nops);
+			jit_op(k, JIT_FLUSH, e & SLOT_ARG);
+			if (e & SLOT_FENCE)
+				jit_op(k, JIT_FENCE, 0);
+		}
+	} else {
 		for (size_t j = 0; j < patt->len; j++) {
-			clflushopt(v_lst[j]);
+			jit_op(k, JIT_ACCESS, j);
+			if (p->jit_nops)
+				jit_op(k, JIT_NOP, p->jit_nops);
+		}
+		for (size_t j = 0; j < patt->len; j++)
+			jit_op(k, JIT_FLUSH, j);
+	}
+	patt->kernel = jit_compile(k, patt->len);
+}
+
+/*
+ Resolve the aggressors of patt for every bank. Only the rows of
+ patt->d_lst are used, the bank is replaced with each bank in turn.
+ */
+void resolve_pattern(HammerSuite * suite, HammerPattern * patt)
+{
+	ResolvedPattern *r_patt = &suite->r_patt;
+	size_t n = patt->len * get_banks_cnt();
+
+	if (suite->stats.setup_cnt == 0)
+		print_time("first hammer", realtime_now() - g_t_start);
+	if (suite->stats.legacy_cnt == 0 && (p->g_flags & F_VERBOSE))
+		sample_legacy_setup(suite, patt);
+
+	uint64_t t0 = realtime_now();
+	if (n > r_patt->cap) {
+		free(r_patt->v_lst);
+		if (posix_memalign((void **)&r_patt->v_lst, CL_SIZE, sizeof(char *) * n)) {
+			fprintf(stderr, "[ERROR] - Unable to allocate resolved pattern\n");
+			exit(1);
 		}
+		r_patt->cap = n;
+	}
+	r_patt->len = patt->len;
+
+	DRAMAddr d_tmp;
+	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+		for (size_t i = 0; i < patt->len; i++) {
+			d_tmp = patt->d_lst[i];
+			d_tmp.bank = bk;
+			r_patt->v_lst[bk * patt->len + i] =
+			    get_dram_pte(suite->mapper, &d_tmp).v_addr;
+		}
+	}
+	if (patt->f_lst)
+		expand_pattern(suite, patt);
+	if (p->jit)
+		jit_pattern(suite, patt);
+	build_victim_window(suite, patt);
+	suite->stats.setup_ns += ticks_2_ns(realtime_now() - t0);
+	suite->stats.setup_cnt++;
+}
+
+char **get_bank_aggrs(ResolvedPattern * r_patt, size_t bk)
+{
+	return &r_patt->v_lst[bk * r_patt->len];
+}
+
+void print_stats(HammerSuite * suite)
+{
+	HammerStats *st = &suite->stats;
+	if (st->setup_cnt == 0)
+		return;
+	fprintf(stderr, "[STAT] - patterns: %ld, setup: %ld ns/pattern",
+		st->setup_cnt, st->setup_ns / st->setup_cnt);
+	if (st->legacy_cnt)
+		fprintf(stderr, " (legacy: %ld ns/pattern)",
+			st->legacy_ns / st->legacy_cnt);
+	if (st->init_cnt)
+		fprintf(stderr, ", init_chunk: %.2f ms (%ld dirty rows)", (double)st->init_ns / st->init_cnt / 1e6,
+			st->dirty_rows / st->init_cnt);
+	fprintf(stderr, ", scanned: %ld rows/pattern", st->scan_rows / st->setup_cnt);
+	fprintf(stderr, ", rounds: %ld/pattern", st->rounds / st->setup_cnt);
+	if (p->auto_rounds)
+		fprintf(stderr, " (calibration: %.2f ms)", (double)st->calib_ns / st->setup_cnt / 1e6);
+	if (st->act_ns)
+		fprintf(stderr, ", %.2f M act/s", st->acts * 1e3 / st->act_ns);
+	fprintf(stderr, ", flips: %ld", st->flips);
+	if (st->early_cnt)
+		fprintf(stderr, ", early stops: %ld (%ld acts to flip)", st->early_cnt,
+			st->early_acts / st->early_cnt);
+	if (st->short_chunks)
+		fprintf(stderr, ", WARNING: --chunk below tREFW in %ld banks, checked every %ld ms",
+			st->short_chunks, TREFW_NS / 1000000);
+	fprintf(stderr, "\n");
+	if (suite->refresh.threshold)
+		fprintf(stderr, "[STAT] - refresh sync: %.2f us/pattern, %ld timeouts\n",
+			(double)st->sync_ns / st->setup_cnt / 1e3, st->sync_miss);
+	if (st->stage_ns) {
+		uint64_t busy = st->fill_ns + st->hammer_ns + st->scan_ns;
+		fprintf(stderr, "[STAT] - stages: fill %.2f ms, hammer %.2f ms, scan %.2f ms, wall %.2f ms/pattern, overlap %.1f%%\n",
+			(double)st->fill_ns / st->setup_cnt / 1e6,
+			(double)st->hammer_ns / st->setup_cnt / 1e6,
+			(double)st->scan_ns / st->setup_cnt / 1e6,
+			(double)st->stage_ns / st->setup_cnt / 1e6,
+			busy > st->stage_ns ? 100.0 * (busy - st->stage_ns) / busy : 0.0);
 	}
+}
+
+// iterations of the hammer loop for patt->rounds, see hammer_loop()
+static size_t hammer_iters(HammerPattern * patt)
+{
+	// as many accesses with a schedule as the uniform loop
+	if (patt->sched) {
+		size_t iters = patt->rounds * patt->len / patt->sched_acts;
+		return iters ? iters : 1;
+	}
+	return patt->rounds;
+}
+
+static void refresh_sync(HammerSuite * suite, char **v_lst)
+{
+	RefreshDet *rd = &suite->refresh;
+	if (!rd->threshold)
+		return;
+	uint64_t t0 = realtime_now();
+	if (!refresh_wait(rd, v_lst[0]))
+		__atomic_fetch_add(&suite->stats.sync_miss, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&suite->stats.sync_ns, ticks_2_ns(realtime_now() - t0), __ATOMIC_RELAXED);
+}
+
+/*
+ Threshold of refresh_sync(): -t as given, or --refresh-sync detects the
+ stalls and their tREFI period from the first row of the suite.
+ */
+static void init_refresh(HammerSuite * suite)
+{
+	RefreshDet *rd = &suite->refresh;
+	memset(rd, 0x00, sizeof(RefreshDet));
+	if (p->threshold > 0) {
+		rd->threshold = p->threshold;
+		return;
+	}
+	if (!p->refresh_sync)
+		return;
+	char *addr = get_dram_pte(suite->mapper, &suite->d_base).v_addr;
+	if (refresh_detect(rd, addr) == 0)
+		rd->offset = rd->period * p->refresh_phase / 100;
+	refresh_report(rd);
+}
+
+static void hammer_loop(HammerPattern * patt, char **v_lst, size_t iters)
+{
+	if (patt->kernel) {
+		patt->kernel(v_lst, iters);
+	} else if (patt->sched) {
+		for (size_t i = 0; i < iters; i++) {
+			mfence();
+			for (size_t s = 0; s < patt->sched_len; s++) {
+				uint32_t e = patt->sched[s];
+				if (e & SLOT_IDLE) {
+					spin((e & SLOT_ARG) * FREQ_IDLE_SPINS);
+					continue;
+				}
+				char *v_addr = v_lst[e & SLOT_ARG];
+				*(volatile char *)v_addr;
+				clflushopt(v_addr);
+				if (e & SLOT_FENCE)
+					mfence();
+			}
+		}
+	} else {
+		for (size_t i = 0; i < iters; i++) {
+			mfence();
+			for (size_t j = 0; j < patt->len; j++) {
+				*(volatile char*) v_lst[j];
+			}
+			for (size_t j = 0; j < patt->len; j++) {
+				clflushopt(v_lst[j]);
+			}
+		}
+	}
+}
+
+/*
+ Set patt->rounds to p->auto_rounds refresh windows, timing CALIB_ITERS
+ iterations on the aggressors of bank 0. The rounds follow the iterations
+ of hammer_iters(), so every pattern gets the same time budget whatever
+ its aggressors and schedule. The calibration stays far below the
+ activations needed for a flip.
+ */
+static void calibrate_rounds(HammerSuite * suite, HammerPattern * patt)
+{
+	char **v_lst = get_bank_aggrs(&suite->r_patt, 0);
+	size_t per_iter = patt->sched ? patt->sched_acts : patt->len;
+
+	uint64_t t0 = realtime_now();
+	hammer_loop(patt, v_lst, CALIB_ITERS / 8);	// warm up TLB and caches
+	uint64_t t1 = realtime_now();
+	hammer_loop(patt, v_lst, CALIB_ITERS);
+	uint64_t t2 = realtime_now();
+
+	uint64_t ns = t2 > t1 ? ticks_2_ns(t2 - t1) : 1;
+	uint64_t iters = p->auto_rounds * TREFW_NS * CALIB_ITERS / ns;
+	patt->rounds = iters * per_iter / patt->len;
+	patt->rounds = patt->rounds ? patt->rounds : 1;
+	suite->stats.calib_ns += ticks_2_ns(t2 - t0);
+}
+
+// v_lst holds the aggressors of a single bank, see get_bank_aggrs()
+uint64_t hammer_it(HammerSuite * suite, HammerPattern* patt, char **v_lst) {
+
+	sched_yield_helper();
+	refresh_sync(suite, v_lst);
+
+	uint64_t cl0, cl1;
+	cl0 = realtime_now();
+	hammer_loop(patt, v_lst, hammer_iters(patt));
 	cl1 = realtime_now();
 
-	free(v_lst);
-	return (cl1-cl0) / 1000000;
+	return ticks_2_ns(cl1-cl0);
 
 }
 
@@ -256,6 +720,16 @@ uint64_t hammer_it(HammerPattern* patt, MemoryBuffer* mem) {
 
 // }
 
+/* Remember that a row of the suite has to be rewritten by init_chunk(). */
+static inline void mark_dirty(HammerSuite * suite, DRAMAddr * d_addr)
+{
+	size_t row = d_addr->row - suite->mapper->base_row;
+	if (row >= suite->cfg->h_rows)
+		return;
+	size_t bit = d_addr->bank * suite->cfg->h_rows + row;
+	__atomic_fetch_or(&suite->dirty[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+}
+
 // DRAMAddr needs to be a copy in order to leave intact the original address
 void fill_stripe(DRAMAddr d_addr, uint8_t val, ADDRMapper * mapper)
 {
@@ -272,6 +746,7 @@ void fill_row(HammerSuite *suite, DRAMAddr *d_addr, HammerData data_patt, int re
 	if (p->vpat != (void *)NULL && p->tpat != (void *)NULL) {
 		uint8_t pat = reverse ? *p->vpat : *p->tpat;
 		fill_stripe(*d_addr, pat, suite->mapper);
+		mark_dirty(suite, d_addr);
 		return;
 	}
 
@@ -285,9 +760,11 @@ void fill_row(HammerSuite *suite, DRAMAddr *d_addr, HammerData data_patt, int re
 		break;
 	case ONE_TO_ZERO:
 		fill_stripe(*d_addr, 0x00, suite->mapper);
+		mark_dirty(suite, d_addr);
 		break;
 	case ZERO_TO_ONE:
 		fill_stripe(*d_addr, 0xff, suite->mapper);
+		mark_dirty(suite, d_addr);
 		break;
 	default:
 		// fprintf(stderr, "[ERROR] - Wrong data pattern %d\n", data_patt);
@@ -297,129 +774,226 @@ void fill_row(HammerSuite *suite, DRAMAddr *d_addr, HammerData data_patt, int re
 
 }
 
-void cl_rand_fill(DRAM_pte * pte)
+uint64_t cl_rand_comp(DRAM_pte * pte)
 {
 	char *rand_data = cl_rand_gen(&pte->d_addr, CL_SEED);
-	memcpy(pte->v_addr, rand_data, CL_SIZE);
+	return cl_diff(pte->v_addr, rand_data);
 }
 
-uint64_t cl_rand_comp(DRAM_pte * pte)
+typedef struct {
+	HammerSuite *suite;
+	size_t bk0;		// first bank of the worker
+	size_t step;		// workers
+	bool rand;		// random data, else val
+	uint8_t val;
+} InitJob;
+
+/* Write the initial content of a row with streaming stores, no fence. */
+static void init_row(HammerSuite * suite, DRAMAddr d_row, bool rand, uint8_t val)
 {
-	char *rand_data = cl_rand_gen(&pte->d_addr, CL_SEED);
-	uint64_t res = 0;
-	for (int i = 0; i < CL_SIZE; i++) {
-		if (*(pte->v_addr + i) != rand_data[i]) {
-			res |= 1UL<<i;
-		}
+	RowMap rmap = get_row_map(suite->mapper, &d_row);
+	for (size_t cl = 0; cl < rmap.len; cl++) {
+		d_row.col = cl << CL_SHIFT;
+		if (rand)
+			cl_rand_stream(rmap_cl(&rmap, cl), &d_row, CL_SEED);
+		else
+			cl_val_stream(rmap_cl(&rmap, cl), val);
 	}
-	return res;
 }
 
-void init_random(HammerSuite * suite)
+/* Fill banks bk0, bk0 + step, ... of the suite, one row at a time. */
+static void *init_banks(void *arg)
 {
-    read_random(CL_SEED);
-	ADDRMapper *mapper = suite->mapper;
+	InitJob *job = (InitJob *) arg;
+	HammerSuite *suite = job->suite;
 	DRAMAddr d_tmp;
-	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+
+	for (size_t bk = job->bk0; bk < get_banks_cnt(); bk += job->step) {
 		d_tmp.bank = bk;
 		for (size_t row = 0; row < suite->cfg->h_rows; row++) {
 			d_tmp.row = suite->mapper->base_row + row;
-			for (size_t col = 0; col < ROW_SIZE; col += (1 << 6)) {
-				d_tmp.col = col;
-				DRAM_pte d_pte = get_dram_pte(mapper, &d_tmp);
-				cl_rand_fill(&d_pte);
-			}
+			init_row(suite, d_tmp, job->rand, job->val);
 		}
 	}
+	sfence();
+	return NULL;
 }
 
-void init_stripe(HammerSuite * suite, uint8_t val)
+/* Split the banks over p->threads workers, the caller is worker 0. */
+static void init_rows(HammerSuite * suite, bool rand, uint8_t val)
 {
-	ADDRMapper *mapper = suite->mapper;
-	DRAMAddr d_tmp;
-	// fprintf(stderr, "bk number: %ld\n", get_banks_cnt());
-	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
-		d_tmp.bank = bk;
-		// fprintf(stderr, "row: %d\n", suite->cfg->h_rows);
-		for (size_t row = 0; row < suite->cfg->h_rows; row++) {
-
-		    // fprintf(stderr, "base_row: %d,  row: %d\n", suite->mapper->base_row, row);
-
-			d_tmp.row = suite->mapper->base_row + row;
-			for (size_t col = 0; col < ROW_SIZE; col += (1 << 6)) {
-				d_tmp.col = col;
-				DRAM_pte d_pte = get_dram_pte(mapper, &d_tmp);
-				// fprintf(stderr,"d_tmp: %s,  v_addr: %p\n", dAddr_2_str(d_tmp, ALL_FIELDS), d_pte.v_addr);
-
-				memset(d_pte.v_addr, val, CL_SIZE);
-			}
+	size_t n = p->threads < get_banks_cnt() ? p->threads : get_banks_cnt();
+	n = n ? n : 1;
+	pthread_t tid[MAX_THREADS];
+	InitJob job[MAX_THREADS];
+
+	for (size_t t = 0; t < n; t++) {
+		job[t].suite = suite;
+		job[t].bk0 = t;
+		job[t].step = n;
+		job[t].rand = rand;
+		job[t].val = val;
+		if (t && pthread_create(&tid[t], NULL, init_banks, &job[t])) {
+			fprintf(stderr, "[ERROR] - Unable to start init thread\n");
+			exit(1);
 		}
 	}
+	init_banks(&job[0]);
+	for (size_t t = 1; t < n; t++)
+		pthread_join(tid[t], NULL);
 }
 
-void init_chunk(HammerSuite * suite)
+void init_random(HammerSuite * suite)
+{
+	read_random(CL_SEED);
+	init_rows(suite, true, 0);
+}
+
+void init_stripe(HammerSuite * suite, uint8_t val)
+{
+	init_rows(suite, false, val);
+}
+
+/* Data of every row after init_chunk(): true for random data, else *val. */
+static bool chunk_data(HammerSuite * suite, uint8_t * val)
 {
 	if (p->vpat != (void *)NULL && p->tpat != (void *)NULL) {
-		// fprintf(stderr, "init chunk\n");
-		init_stripe(suite, (uint8_t) * p->vpat);
-		return;
+		*val = (uint8_t) * p->vpat;
+		return false;
 	}
-	
+
 	SessionConfig *cfg = suite->cfg;
 	switch (cfg->d_cfg) {
 	case RANDOM:
-		init_random(suite);
-		break;
+		return true;
 	case ONE_TO_ZERO:
-		init_stripe(suite, 0xff);
-		break;
+		*val = 0xff;
+		return false;
 	case ZERO_TO_ONE:
-		init_stripe(suite, 0x00);
-		break;
+		*val = 0x00;
+		return false;
 	default:
 		fprintf(stderr, "[ERROR] - Wrong data pattern %d\n",
 			cfg->d_cfg);
 		exit(1);
-		break;
 	}
 }
 
-void scan_random(HammerSuite * suite, HammerPattern * h_patt, size_t adj_rows)
+void fill_chunk(HammerSuite * suite)
 {
-	ADDRMapper *mapper = suite->mapper;
-	SessionConfig *cfg = suite->cfg;
+	uint8_t val;
+	if (chunk_data(suite, &val))
+		init_random(suite);
+	else
+		init_stripe(suite, val);
+}
 
+/* Rewrite only the rows marked by mark_dirty(). */
+static void refill_dirty(HammerSuite * suite)
+{
+	uint8_t val = 0;
+	bool rand = chunk_data(suite, &val);
+	size_t h_rows = suite->cfg->h_rows;
+	size_t words = (get_banks_cnt() * h_rows + 63) / 64;
 	DRAMAddr d_tmp;
+
+	for (size_t w = 0; w < words; w++) {
+		for (uint64_t bits = suite->dirty[w]; bits; bits &= bits - 1) {
+			size_t bit = w * 64 + __builtin_ctzll(bits);
+			d_tmp.bank = bit / h_rows;
+			d_tmp.row = suite->mapper->base_row + bit % h_rows;
+			init_row(suite, d_tmp, rand, val);
+			suite->stats.dirty_rows++;
+		}
+	}
+	sfence();
+}
+
+/*
+ The first call and every p->refresh_every calls rewrite all rows, the
+ others only the rows written as aggressors or repaired since the last call.
+ */
+void init_chunk(HammerSuite * suite)
+{
+	size_t words = (get_banks_cnt() * suite->cfg->h_rows + 63) / 64;
+	uint64_t cnt = suite->init_off + suite->stats.init_cnt;
+	bool first = suite->dirty == NULL;
+	bool full = first || (p->refresh_every && cnt % p->refresh_every == 0);
+
+	uint64_t t0 = realtime_now();
+	if (first) {
+		suite->dirty = (uint64_t *) calloc(words, sizeof(uint64_t));
+		assert(suite->dirty != NULL);
+	}
+	if (full)
+		fill_chunk(suite);
+	else
+		refill_dirty(suite);
+	memset(suite->dirty, 0x00, words * sizeof(uint64_t));
+	uint64_t dt = realtime_now() - t0;
+
+	suite->stats.init_ns += ticks_2_ns(dt);
+	suite->stats.init_cnt++;
+	if (first)
+		print_time("init_chunk", dt);
+}
+
+/* Flush n consecutive rows of a bank starting at d_row, then fence once. */
+static void flush_rows(HammerSuite * suite, DRAMAddr d_row, size_t n)
+{
+	for (size_t r = 0; r < n; r++, d_row.row++) {
+		RowMap rmap = get_row_map(suite->mapper, &d_row);
+		for (size_t cl = 0; cl < rmap.len; cl++)
+			clflushopt(rmap_cl(&rmap, cl));
+	}
+	mfence();
+}
+
+/* Compare a (flushed) row against its random data, report and repair flips. */
+static void scan_random_row(HammerSuite * suite, HammerPattern * h_patt,
+			    DRAMAddr d_row)
+{
+	RowMap rmap = get_row_map(suite->mapper, &d_row);
 	FlipVal flip;
 
+	flip.h_patt = h_patt;
+	for (size_t cl = 0; cl < rmap.len; cl++) {
+		char *v_addr = rmap_cl(&rmap, cl);
+		d_row.col = cl << CL_SHIFT;
+		char *rand_data = cl_rand_gen(&d_row, CL_SEED);
+		uint64_t res = cl_diff(v_addr, rand_data);
+		if (__builtin_expect(!res, 1))
+			continue;
+
+		__atomic_fetch_add(&suite->stats.flips, __builtin_popcountll(res), __ATOMIC_RELAXED);
+		for (; res; res &= res - 1) {
+			int off = __builtin_ctzll(res);
+			flip.d_vict = d_row;
+			flip.d_vict.col += off;
+			flip.f_og = (uint8_t) rand_data[off];
+			flip.f_new = *(uint8_t *) (v_addr + off);
+			assert(flip.f_og != flip.f_new);
+			export_flip(&flip);
+		}
+		memcpy(v_addr, rand_data, CL_SIZE);
+		mark_dirty(suite, &d_row);
+	}
+}
+
+// scans rows [lo, hi) of the bank of h_patt, relative to mapper->base_row
+void scan_random(HammerSuite * suite, HammerPattern * h_patt, size_t lo, size_t hi)
+{
+	DRAMAddr d_tmp;
+
 	d_tmp.bank = h_patt->d_lst[0].bank;
+	d_tmp.col = 0;
 
-	for (size_t row = 0; row < cfg->h_rows; row++) {
+	for (size_t row = lo; row < hi; row += SCAN_BATCH) {
+		size_t n = hi - row < SCAN_BATCH ? hi - row : SCAN_BATCH;
 		d_tmp.row = suite->mapper->base_row + row;
-		for (size_t col = 0; col < ROW_SIZE; col += (1 << 6)) {
-			d_tmp.col = col;
-			DRAM_pte pte = get_dram_pte(mapper, &d_tmp);
-			clflush(pte.v_addr);
-			cpuid();
-			uint64_t res = cl_rand_comp(&pte);
-			if (res) {
-				char *rand_data = cl_rand_gen(&pte.d_addr, CL_SEED);
-				for (int off = 0; off < CL_SIZE; off++) {
-					if (!((res >> off) & 1))
-						continue;
-					d_tmp.col += off;
-
-					flip.d_vict = d_tmp;
-					flip.f_og = (uint8_t) rand_data[off];
-					flip.f_new = *(uint8_t *) (pte.v_addr + off);
-					flip.h_patt = h_patt;
-					assert(flip.f_og != flip.f_new);
-					export_flip(&flip);
-
-				}
-				memcpy((char *)(pte.v_addr), rand_data, CL_SIZE);
-			}
-		}
+		flush_rows(suite, d_tmp, n);
+		for (size_t r = 0; r < n; r++, d_tmp.row++)
+			scan_random_row(suite, h_patt, d_tmp);
 	}
 }
 
@@ -455,73 +1029,72 @@ bool in_hPatt(DRAMAddr * d_addr, HammerPattern * h_patt)
 	return false;
 }
 
-uint64_t cl_stripe_cmp(DRAM_pte * pte, uint8_t val)
+uint64_t cl_stripe_cmp(char *v_addr, uint8_t val)
 {
-	uint64_t res = 0;
+	uint64_t res = cl_diff_val(v_addr, val);
 #ifdef POINTER_CHAISING
-	for (int_t i = 8; i < CL_SIZE; i++) {
-#else
-	for (int i = 0; i < CL_SIZE; i++) {
+	res &= ~0xffULL;	// first 8 bytes hold the next pointer
 #endif
-		if (*(uint8_t*) (pte->v_addr + i) != val) {
-			res |= 1UL<<i;
+	return res;
+}
+
+/* Compare a (flushed) row against t_val, report and repair flips. */
+static void scan_stripe_row(HammerSuite * suite, HammerPattern * h_patt,
+			    DRAMAddr d_row, uint8_t t_val)
+{
+	RowMap rmap = get_row_map(suite->mapper, &d_row);
+	FlipVal flip;
+
+	flip.h_patt = h_patt;
+	flip.f_og = t_val;
+	for (size_t cl = 0; cl < rmap.len; cl++) {
+		char *v_addr = rmap_cl(&rmap, cl);
+		uint64_t res = cl_stripe_cmp(v_addr, t_val);
+		if (__builtin_expect(!res, 1))
+			continue;
+
+		__atomic_fetch_add(&suite->stats.flips, __builtin_popcountll(res), __ATOMIC_RELAXED);
+		for (; res; res &= res - 1) {
+			int off = __builtin_ctzll(res);
+			flip.d_vict = d_row;
+			flip.d_vict.col = (cl << CL_SHIFT) + off;
+			flip.f_new = *(uint8_t *) (v_addr + off);
+			export_flip(&flip);
 		}
+		memset(v_addr, t_val, CL_SIZE);
+		mark_dirty(suite, &d_row);
 	}
-	return res;
 }
 
-void scan_stripe(HammerSuite * suite, HammerPattern * h_patt, size_t adj_rows,
+void scan_stripe(HammerSuite * suite, HammerPattern * h_patt, size_t lo, size_t hi,
 		 uint8_t val)
 {
-	ADDRMapper *mapper = suite->mapper;
-	SessionConfig *cfg = suite->cfg;
-
 	DRAMAddr d_tmp;
-	FlipVal flip;
 
 	d_tmp.bank = h_patt->d_lst[0].bank;
-	uint8_t t_val = val;
+	d_tmp.col = 0;
 
-	for (size_t row = 0; row < cfg->h_rows; row++) {
+	for (size_t row = lo; row < hi; row += SCAN_BATCH) {
+		size_t n = hi - row < SCAN_BATCH ? hi - row : SCAN_BATCH;
 		d_tmp.row = suite->mapper->base_row + row;
-		t_val = val;
-		if (in_hPatt(&d_tmp, h_patt))
-			if (p->tpat != (void *)NULL && p->vpat != (void *)NULL)
-				t_val = (uint8_t) * p->tpat;
-			else
-				t_val ^= 0xff;
-
-		for (size_t col = 0; col < ROW_SIZE; col += (1 << 6)) {
-			d_tmp.col = col;
-			DRAM_pte pte = get_dram_pte(mapper, &d_tmp);
-			clflush(pte.v_addr);
-			cpuid();
-
-			uint64_t res = cl_stripe_cmp(&pte, t_val);
-			if (res) {
-				for (int off = 0; off < CL_SIZE; off++) {
-					if (!((res >> off) & 1))
-						continue;
-					d_tmp.col += off;
-
-					flip.d_vict = d_tmp;
-					flip.f_og = (uint8_t) t_val;
-					flip.f_new = *(uint8_t *) (pte.v_addr + off);
-					flip.h_patt = h_patt;
-					export_flip(&flip);
-					memset(pte.v_addr + off, t_val, 1);
-				}
-				memset((char *)(pte.v_addr), t_val, CL_SIZE);
+		flush_rows(suite, d_tmp, n);
+		for (size_t r = 0; r < n; r++, d_tmp.row++) {
+			uint8_t t_val = val;
+			if (in_hPatt(&d_tmp, h_patt)) {
+				if (p->tpat != (void *)NULL && p->vpat != (void *)NULL)
+					t_val = (uint8_t) * p->tpat;
+				else
+					t_val ^= 0xff;
 			}
+			scan_stripe_row(suite, h_patt, d_tmp, t_val);
 		}
 	}
 }
 
-// TODO adj_rows should tell how many rows to scan out of the bank. Not currently used
-void scan_rows(HammerSuite * suite, HammerPattern * h_patt, size_t adj_rows)
+void scan_range(HammerSuite * suite, HammerPattern * h_patt, size_t lo, size_t hi)
 {
 	if (p->vpat != (void *)NULL && p->tpat != (void *)NULL) {
-		scan_stripe(suite, h_patt, adj_rows, (uint8_t) * p->vpat);
+		scan_stripe(suite, h_patt, lo, hi, (uint8_t) * p->vpat);
 		return;
 	}
 
@@ -529,13 +1102,13 @@ void scan_rows(HammerSuite * suite, HammerPattern * h_patt, size_t adj_rows)
 	switch (cfg->d_cfg) {
 	case RANDOM:
 		// rows are already filled for random data patt
-		scan_random(suite, h_patt, adj_rows);
+		scan_random(suite, h_patt, lo, hi);
 		break;
 	case ONE_TO_ZERO:
-		scan_stripe(suite, h_patt, adj_rows, 0xff);
+		scan_stripe(suite, h_patt, lo, hi, 0xff);
 		break;
 	case ZERO_TO_ONE:
-		scan_stripe(suite, h_patt, adj_rows, 0x00);
+		scan_stripe(suite, h_patt, lo, hi, 0x00);
 		break;
 	default:
 		fprintf(stderr, "[ERROR] - Wrong data pattern %d\n",
@@ -545,14 +1118,422 @@ void scan_rows(HammerSuite * suite, HammerPattern * h_patt, size_t adj_rows)
 	}
 }
 
+// scans the victim window built by resolve_pattern(), see build_victim_window()
+void scan_rows(HammerSuite * suite, HammerPattern * h_patt)
+{
+	VictimWindow *win = &suite->win;
+	for (size_t i = 0; i < win->len; i++) {
+		scan_range(suite, h_patt, win->lst[i].lo, win->lst[i].hi);
+		__atomic_fetch_add(&suite->stats.scan_rows, win->lst[i].hi - win->lst[i].lo,
+				   __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ Pool of p->threads pinned workers. Worker id owns banks id, id + n, ... and
+ runs fill -> hammer_it -> scan -> restore on them. The caller is worker 0;
+ with a single worker everything runs inline as before.
+ */
+typedef struct {
+	FTBuffer ft;		// fliptable records of the bank
+	uint64_t time;		// hammer time of the bank in ns
+	uint64_t hammered;	// activations of the bank
+	uint64_t acts;		// activations up to the first flip, 0 = no early stop
+	uint64_t first_ns;	// hammer time up to the first flip
+} BankOut;
+
+typedef struct {
+	struct HammerPool *pool;
+	size_t id;
+	pthread_t tid;
+	DRAMAddr *d_lst;	// the pattern moved to the banks of the worker
+	size_t cap;
+} HammerWorker;
+
+typedef struct HammerPool {
+	size_t n;
+	HammerWorker w[MAX_THREADS];
+	BankOut *out;		// one per bank
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+	HammerSuite *suite;	// job of the current pool_attack()
+	HammerPattern *patt;
+	bool quit;
+	pthread_t helper;	// fill/scan stages of pool_pipeline()
+	pthread_barrier_t step;
+	size_t k;		// bank hammered in the current step
+} HammerPool;
+
+/* patt moved to bank bk, in the scratch list of the worker. */
+static HammerPattern bank_pattern(HammerWorker * w, HammerPattern * patt, size_t bk)
+{
+	HammerPattern b_patt = *patt;
+
+	if (patt->len > w->cap) {
+		free(w->d_lst);
+		w->d_lst = (DRAMAddr *) malloc(sizeof(DRAMAddr) * patt->len);
+		assert(w->d_lst != NULL);
+		w->cap = patt->len;
+	}
+	b_patt.d_lst = w->d_lst;
+	for (size_t idx = 0; idx < patt->len; idx++) {
+		b_patt.d_lst[idx] = patt->d_lst[idx];
+		b_patt.d_lst[idx].bank = bk;
+	}
+	return b_patt;
+}
+
+/*
+ Cheap check between two chunks of hammering: did any row next to an
+ aggressor of patt flip? Nothing is reported or repaired, scan_rows()
+ does it once the bank is done.
+ */
+static bool peek_victims(HammerSuite * suite, HammerPattern * patt)
+{
+	uint8_t val = 0;
+	bool rand = chunk_data(suite, &val);
+	size_t base = suite->mapper->base_row;
+
+	for (size_t i = 0; i < patt->len; i++) {
+		for (int delta = -1; delta <= 1; delta += 2) {
+			DRAMAddr d_row = patt->d_lst[i];
+			d_row.row += delta;
+			d_row.col = 0;
+			if (d_row.row - base >= suite->cfg->h_rows || in_hPatt(&d_row, patt))
+				continue;
+			flush_rows(suite, d_row, 1);
+			RowMap rmap = get_row_map(suite->mapper, &d_row);
+			for (size_t cl = 0; cl < rmap.len; cl++) {
+				char *v_addr = rmap_cl(&rmap, cl);
+				d_row.col = cl << CL_SHIFT;
+				uint64_t res = rand ? cl_diff(v_addr, cl_rand_gen(&d_row, CL_SEED))
+				    : cl_stripe_cmp(v_addr, val);
+				if (res)
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+static void count_acts(HammerSuite * suite, BankOut * out, uint64_t acts, uint64_t ns)
+{
+	out->hammered = acts;
+	__atomic_fetch_add(&suite->stats.acts, acts, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&suite->stats.act_ns, ns, __ATOMIC_RELAXED);
+}
+
+/*
+ Hammer patt on bank bk. With p->chunk the rounds run p->chunk at a time
+ and the bank stops at the first flip found by peek_victims(), the pool
+ output of the bank keeps the activations and time it took. The peek opens
+ the victim rows, which restores their charge like a refresh would, so it
+ waits for at least TREFW_NS of hammering since the last one: shorter
+ chunks only make the stop finer, never reset the victims more often than
+ the refresh does.
+ */
+static uint64_t hammer_bank(HammerWorker * w, HammerSuite * suite,
+			    HammerPattern * patt, size_t bk)
+{
+	char **v_lst = get_bank_aggrs(&suite->r_patt, bk);
+	BankOut *out = &w->pool->out[bk];
+	size_t per_iter = patt->sched ? patt->sched_acts : patt->len;
+	size_t iters = hammer_iters(patt);
+	out->acts = 0;
+	if (!p->chunk) {
+		uint64_t ns = hammer_it(suite, patt, v_lst);
+		count_acts(suite, out, iters * per_iter, ns);
+		return ns;
+	}
+
+	HammerPattern b_patt = bank_pattern(w, patt, bk);
+	size_t chunk = p->chunk * patt->len / per_iter;
+	chunk = chunk ? chunk : 1;
+
+	sched_yield_helper();
+	refresh_sync(suite, v_lst);
+	uint64_t ns = 0, peek_ns = 0;
+	size_t done = 0;
+	bool deferred = false;
+	while (done < iters) {
+		size_t n = iters - done < chunk ? iters - done : chunk;
+		uint64_t t0 = realtime_now();
+		hammer_loop(patt, v_lst, n);
+		ns += ticks_2_ns(realtime_now() - t0);
+		done += n;
+		if (ns - peek_ns < TREFW_NS && done < iters) {
+			deferred = true;
+			continue;
+		}
+		peek_ns = ns;
+		if (peek_victims(suite, &b_patt)) {
+			out->acts = done * per_iter;
+			out->first_ns = ns;
+			__atomic_fetch_add(&suite->stats.early_cnt, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&suite->stats.early_acts, done * per_iter, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+	if (deferred)
+		__atomic_fetch_add(&suite->stats.short_chunks, 1, __ATOMIC_RELAXED);
+	count_acts(suite, out, done * per_iter, ns);
+	return ns;
+}
+
+// records of a bank go out in order: FT_FIRST, then its flips
+static void report_first(HammerPool * pool, size_t bk)
+{
+	BankOut *out = &pool->out[bk];
+	if (out->acts)
+		export_first(bk, out->acts, out->first_ns);
+}
+
+/* Stage 1: write the aggressor rows of bank bk. */
+static void stage_fill(HammerWorker * w, HammerSuite * suite, HammerPattern * patt, size_t bk)
+{
+	HammerPattern b_patt = bank_pattern(w, patt, bk);
+	for (size_t idx = 0; idx < b_patt.len; idx++)
+		fill_row(suite, &b_patt.d_lst[idx], suite->cfg->d_cfg, 0);
+}
+
+/* Stage 3: scan the victims of bank bk and restore its aggressor rows. */
+static void stage_scan(HammerWorker * w, HammerSuite * suite, HammerPattern * patt, size_t bk)
+{
+	HammerPattern b_patt = bank_pattern(w, patt, bk);
+	scan_rows(suite, &b_patt);
+	for (size_t idx = 0; idx < b_patt.len; idx++)
+		fill_row(suite, &b_patt.d_lst[idx], suite->cfg->d_cfg, 1);
+}
+
+/* Fill, hammer, scan and restore a single bank with patt moved to bank bk. */
+static uint64_t attack_bank(HammerWorker * w, HammerSuite * suite,
+			    HammerPattern * patt, size_t bk)
+{
+	stage_fill(w, suite, patt, bk);
+	uint64_t time = hammer_bank(w, suite, patt, bk);
+	report_first(w->pool, bk);
+	stage_scan(w, suite, patt, bk);
+	return time;
+}
+
+static void worker_banks(HammerWorker * w)
+{
+	HammerPool *pool = w->pool;
+	for (size_t bk = w->id; bk < get_banks_cnt(); bk += pool->n) {
+		BankOut *out = &pool->out[bk];
+		out->ft.len = 0;
+		t_ft_buf = &out->ft;
+		out->time = attack_bank(w, pool->suite, pool->patt, bk);
+		t_ft_buf = NULL;
+	}
+}
+
+static void *worker_loop(void *arg)
+{
+	HammerWorker *w = (HammerWorker *) arg;
+	HammerPool *pool = w->pool;
+
+	pin_thread(w->id);
+	while (1) {
+		pthread_barrier_wait(&pool->start);
+		if (pool->quit)
+			break;
+		worker_banks(w);
+		pthread_barrier_wait(&pool->done);
+	}
+	return NULL;
+}
+
+/*
+ Work of the helper while bank k is hammered: scan and restore bank k - 1,
+ then fill the aggressors of bank k + 1. The helper also reports the hammer
+ time of bank k - 1 so that a single thread feeds the writer at a time.
+ */
+static void pipeline_side(HammerPool * pool, size_t k)
+{
+	HammerSuite *suite = pool->suite;
+	HammerWorker *w = &pool->w[1];
+	uint64_t t0 = realtime_now();
+	if (k > 0) {
+		report_first(pool, k - 1);
+		stage_scan(w, suite, pool->patt, k - 1);
+		out_time(k - 1, pool->out[k - 1].time, pool->out[k - 1].hammered);
+	}
+	uint64_t t1 = realtime_now();
+	if (k + 1 < get_banks_cnt())
+		stage_fill(w, suite, pool->patt, k + 1);
+	uint64_t t2 = realtime_now();
+
+	suite->stats.scan_ns += ticks_2_ns(t1 - t0);
+	suite->stats.fill_ns += ticks_2_ns(t2 - t1);
+}
+
+static void *helper_loop(void *arg)
+{
+	HammerPool *pool = (HammerPool *) arg;
+
+	pin_thread(1);
+	while (1) {
+		pthread_barrier_wait(&pool->step);
+		if (pool->quit)
+			break;
+		pipeline_side(pool, pool->k);
+		pthread_barrier_wait(&pool->step);
+	}
+	return NULL;
+}
+
+/*
+ Two-stage pipeline over the banks: the caller hammers bank k while the
+ helper scans bank k - 1 and fills bank k + 1. With --serialize the same
+ stages run one after the other on the caller.
+ */
+static void pool_pipeline(HammerSuite * suite, HammerPattern * patt)
+{
+	HammerPool *pool = suite->pool;
+	HammerStats *st = &suite->stats;
+	size_t bks = get_banks_cnt();
+
+	pool->suite = suite;
+	pool->patt = patt;
+
+	uint64_t t_start = realtime_now();
+	stage_fill(&pool->w[1], suite, patt, 0);
+	st->fill_ns += ticks_2_ns(realtime_now() - t_start);
+
+	for (size_t k = 0; k <= bks; k++) {
+		pool->k = k;
+		if (!p->serialize)
+			pthread_barrier_wait(&pool->step);
+		if (k < bks) {
+			uint64_t t0 = realtime_now();
+			pool->out[k].time = hammer_bank(&pool->w[0], suite, patt, k);
+			st->hammer_ns += ticks_2_ns(realtime_now() - t0);
+		}
+		if (p->serialize)
+			pipeline_side(pool, k);
+		else
+			pthread_barrier_wait(&pool->step);
+	}
+	st->stage_ns += ticks_2_ns(realtime_now() - t_start);
+}
+
+void init_pool(HammerSuite * suite)
+{
+	HammerPool *pool = (HammerPool *) calloc(1, sizeof(HammerPool));
+	assert(pool != NULL);
+	pool->n = p->threads < get_banks_cnt() ? p->threads : get_banks_cnt();
+	pool->n = pool->n ? pool->n : 1;
+	pool->out = (BankOut *) calloc(get_banks_cnt(), sizeof(BankOut));
+	assert(pool->out != NULL);
+	suite->pool = pool;
+
+	for (size_t t = 0; t < MAX_THREADS; t++) {
+		pool->w[t].pool = pool;
+		pool->w[t].id = t;
+	}
+	if (p->pipeline && pool->n > 1) {
+		fprintf(stderr, "[LOG] - --pipeline uses a single hammer worker, ignoring --threads\n");
+		pool->n = 1;
+	}
+	if (p->pipeline && !p->serialize) {
+		pthread_barrier_init(&pool->step, NULL, 2);
+		pin_thread(0);
+		if (pthread_create(&pool->helper, NULL, helper_loop, pool)) {
+			fprintf(stderr, "[ERROR] - Unable to start pipeline helper\n");
+			exit(1);
+		}
+		fprintf(stderr, "[LOG] - Pipelined hammer/scan stages\n");
+	}
+	if (pool->n == 1)
+		return;
+
+	pthread_barrier_init(&pool->start, NULL, pool->n);
+	pthread_barrier_init(&pool->done, NULL, pool->n);
+	pin_thread(0);
+	for (size_t t = 1; t < pool->n; t++) {
+		if (pthread_create(&pool->w[t].tid, NULL, worker_loop, &pool->w[t])) {
+			fprintf(stderr, "[ERROR] - Unable to start hammer worker %ld\n", t);
+			exit(1);
+		}
+	}
+	fprintf(stderr, "[LOG] - %ld hammer workers\n", pool->n);
+}
+
+void tear_down_pool(HammerSuite * suite)
+{
+	HammerPool *pool = suite->pool;
+	if (p->pipeline && !p->serialize) {
+		pool->quit = true;
+		pthread_barrier_wait(&pool->step);
+		pthread_join(pool->helper, NULL);
+		pthread_barrier_destroy(&pool->step);
+	}
+	if (pool->n > 1) {
+		pool->quit = true;
+		pthread_barrier_wait(&pool->start);
+		for (size_t t = 1; t < pool->n; t++)
+			pthread_join(pool->w[t].tid, NULL);
+		pthread_barrier_destroy(&pool->start);
+		pthread_barrier_destroy(&pool->done);
+	}
+	for (size_t t = 0; t < MAX_THREADS; t++)
+		free(pool->w[t].d_lst);
+	for (size_t bk = 0; bk < get_banks_cnt(); bk++)
+		free(pool->out[bk].ft.rec);
+	free(pool->out);
+	free(pool);
+	suite->pool = NULL;
+}
+
+/*
+ Attack every bank with patt. The hammer times and the flips go to the
+ writer in bank order, whatever the number of workers. table asks for one
+ fliptable line per bank, see ft_convert(). With --auto-rounds the rounds
+ of patt are calibrated first.
+ */
+void pool_attack(HammerSuite * suite, HammerPattern * patt, bool table)
+{
+	HammerPool *pool = suite->pool;
+
+	if (p->auto_rounds)
+		calibrate_rounds(suite, patt);
+	suite->stats.rounds += patt->rounds;
+	out_pattern(patt->d_lst, patt->f_lst, patt->len, patt->rounds, table);
+	if (p->pipeline) {
+		pool_pipeline(suite, patt);
+		return;
+	}
+	if (pool->n == 1) {
+		for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+			uint64_t time = attack_bank(&pool->w[0], suite, patt, bk);
+			out_time(bk, time, pool->out[bk].hammered);
+		}
+		return;
+	}
+
+	pool->suite = suite;
+	pool->patt = patt;
+	pthread_barrier_wait(&pool->start);
+	worker_banks(&pool->w[0]);
+	pthread_barrier_wait(&pool->done);
+
+	for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
+		BankOut *out = &pool->out[bk];
+		for (size_t i = 0; i < out->ft.len; i++)
+			out_record(&out->ft.rec[i]);
+		out_time(bk, out->time, out->hammered);
+	}
+}
+
 int free_triple_sided_test(HammerSuite * suite)
 {
-	MemoryBuffer *mem = suite->mem;
 	SessionConfig *cfg = suite->cfg;
 
 	DRAMAddr d_base = suite->d_base;
 	d_base.col = 0;
 	HammerPattern h_patt;
+	memset(&h_patt, 0x00, sizeof(HammerPattern));
 
 	h_patt.len = 3;
 	h_patt.rounds = cfg->h_rounds;
@@ -574,37 +1555,23 @@ int free_triple_sided_test(HammerSuite * suite)
 			h_patt.d_lst[0].bank = 0;
 			h_patt.d_lst[1].bank = 0;
 			h_patt.d_lst[2].bank = 0;
-			fprintf(stderr, "[HAMMER] - %s: ", hPatt_2_str(&h_patt, ROW_FIELD));
-			for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
-				h_patt.d_lst[0].bank = bk;
-				h_patt.d_lst[1].bank = bk;
-				h_patt.d_lst[2].bank = bk;
-				// fill all the aggressor rows
-				for (int idx = 0; idx < 3; idx++) {
-					fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 0);
-				}
-				uint64_t time = hammer_it(&h_patt, mem);
-				fprintf(stderr, "%ld ", time);
-
-				scan_rows(suite, &h_patt, 0);
-				for (int idx = 0; idx < 3; idx++) {
-					fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 1);
-				}
-			}
-			fprintf(stderr, "\n");
+			resolve_pattern(suite, &h_patt);
+			pool_attack(suite, &h_patt, false);
+			out_eol();
 		}
 	}
 	free(h_patt.d_lst);
+	return 0;
 }
 
 int assisted_double_sided_test(HammerSuite * suite)
 {
-	MemoryBuffer *mem = suite->mem;
 	SessionConfig *cfg = suite->cfg;
 	DRAMAddr d_base = suite->d_base;
 	d_base.col = 0;
 
 	HammerPattern h_patt;
+	memset(&h_patt, 0x00, sizeof(HammerPattern));
 
 	h_patt.len = 3;
 	h_patt.rounds = cfg->h_rounds;
@@ -632,39 +1599,23 @@ int assisted_double_sided_test(HammerSuite * suite)
 		h_patt.d_lst[0].bank = 0;
 		h_patt.d_lst[1].bank = 0;
 		h_patt.d_lst[2].bank = 0;
-		fprintf(stderr, "[HAMMER] - %s: ", hPatt_2_str(&h_patt, ROW_FIELD));
-		for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
-			h_patt.d_lst[0].bank = bk;
-			h_patt.d_lst[1].bank = bk;
-			h_patt.d_lst[2].bank = bk;
-			// fill all the aggressor rows
-			for (int idx = 0; idx < 3; idx++) {
-				fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 0);
-				// fprintf(stderr, "d_addr: %s\n", dram_2_str(&h_patt.d_lst[idx]));
-			}
-			// fprintf(stderr, "d_addr: %s\n", dram_2_str(&h_patt.d_lst[idx]));
-			uint64_t time = hammer_it(&h_patt, mem);
-			fprintf(stderr, "%ld ", time);
-
-			scan_rows(suite, &h_patt, 0);
-			for (int idx = 0; idx<3; idx++) {
-				fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 1);
-			}
-		}
-		fprintf(stderr, "\n");
+		resolve_pattern(suite, &h_patt);
+		pool_attack(suite, &h_patt, false);
+		out_eol();
 	}
 	free(h_patt.d_lst);
+	return 0;
 }
 
 int n_sided_test(HammerSuite * suite)
 {
-	MemoryBuffer *mem = suite->mem;
 	SessionConfig *cfg = suite->cfg;
 	DRAMAddr d_base = suite->d_base;
 	d_base.col = 0;
 	/* d_base.row = 20480; */
     /* d_base.row = 16400; */
 	HammerPattern h_patt;
+	memset(&h_patt, 0x00, sizeof(HammerPattern));
 
 	h_patt.len = cfg->aggr_n;
 	h_patt.rounds = cfg->h_rounds;
@@ -695,41 +1646,38 @@ int n_sided_test(HammerSuite * suite)
 		if (h_patt.d_lst[k - 1].row >= d_base.row + cfg->h_rows)
 			break;
 
-		fprintf(stderr, "[HAMMER] - %s: ", hPatt_2_str(&h_patt, ROW_FIELD));
-		for (size_t bk = 0; bk < get_banks_cnt(); bk++) {
-
-			for (int s = 0; s < cfg->aggr_n; s++) {
-				h_patt.d_lst[s].bank = bk;
-			}
-#ifdef FLIPTABLE
-				print_start_attack(&h_patt);
-#endif
-			// fill all the aggressor rows
-			for (int idx = 0; idx < cfg->aggr_n; idx++) {
-				fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 0);
-			}
-
-			uint64_t time = hammer_it(&h_patt, mem);
-			fprintf(stderr, "%ld ", time);
-			fflush(stderr);
+		resolve_pattern(suite, &h_patt);
+		pool_attack(suite, &h_patt, true);
+		out_eol();
+	}
+	free(h_patt.d_lst);
+	return 0;
+}
 
-			scan_rows(suite, &h_patt, 0);
-			for (int idx = 0; idx<h_patt.len; idx++) {
-				fill_row(suite, &h_patt.d_lst[idx], cfg->d_cfg, 1);
-			}
-#ifdef FLIPTABLE
-				print_end_attack();
-#endif
+/*
+ Random frequency, phase and amplitude for the aggressors of patt. The
+ aggressors of a pair share them and hammer back to back.
+ */
+static void fuzz_freq(HammerPattern * patt)
+{
+	for (size_t i = 0; i < patt->len; i += 2) {
+		AggrFreq f;
+		f.freq = 1 << random_int(0, FREQ_MAX_LOG + 1);
+		f.amp = random_int(1, FREQ_MAX_AMP + 1);
+		f.phase = random_int(0, FREQ_PERIOD / f.freq);
+		patt->f_lst[i] = f;
+		if (i + 1 < patt->len) {
+			f.phase += f.amp;
+			patt->f_lst[i + 1] = f;
 		}
-		fprintf(stderr, "\n");
 	}
-	free(h_patt.d_lst);
 }
 
-void fuzz(HammerSuite *suite, int d, int v)
+void fuzz(HammerSuite *suite, int d, int v, int offset)
 {
 	int i;
 	HammerPattern h_patt;
+	memset(&h_patt, 0x00, sizeof(HammerPattern));
 	SessionConfig *cfg = suite->cfg;
 	h_patt.rounds = cfg->h_rounds;
 	h_patt.len = cfg->aggr_n;
@@ -738,7 +1686,6 @@ void fuzz(HammerSuite *suite, int d, int v)
 	memset(h_patt.d_lst, 0x00, sizeof(DRAMAddr) * h_patt.len);
 
 	init_chunk(suite);
-	int offset = random_int(1, 32);
 
 	h_patt.d_lst[0] = suite->d_base;
 	h_patt.d_lst[0].row = suite->d_base.row + offset;
@@ -755,40 +1702,75 @@ void fuzz(HammerSuite *suite, int d, int v)
 		h_patt.d_lst[h_patt.len-1] = suite->d_base;
 		h_patt.d_lst[h_patt.len-1].row = h_patt.d_lst[h_patt.len-2].row + d + 1;
 	}
+	if (p->freq) {
+		h_patt.f_lst = (AggrFreq *) malloc(sizeof(AggrFreq) * h_patt.len);
+		fuzz_freq(&h_patt);
+	}
 
-	fprintf(stderr, "[HAMMER] - %s: ", hPatt_2_str(&h_patt, ROW_FIELD));
-	for (int bk = 0; bk < get_banks_cnt(); bk++)
-	{
-		for (int idx = 0; idx < h_patt.len; idx++) {
-			h_patt.d_lst[idx].bank = bk;
-		}
-#ifdef FLIPTABLE
-		print_start_attack(&h_patt);
-#endif
-		for (int idx = 0; idx < h_patt.len; idx++)
-			fill_row(suite, &h_patt.d_lst[idx], suite->cfg->d_cfg, 0);
+	resolve_pattern(suite, &h_patt);
+	pool_attack(suite, &h_patt, true);
+	out_eol();
+	free(h_patt.d_lst);
+	free(h_patt.f_lst);
+}
 
-		uint64_t time = hammer_it(&h_patt, suite->mem);
-		fprintf(stderr, "%lu ",time);
+static volatile sig_atomic_t g_stop = 0;
 
-		scan_rows(suite, &h_patt, 0);
-		for (int idx = 0; idx<h_patt.len; idx++) {
-			fill_row(suite, &h_patt.d_lst[idx], suite->cfg->d_cfg, 1);
-		}
+static void on_stop(int sig)
+{
+	g_stop = sig;
+}
 
+/* Save the session state once the output is on disk up to this pattern. */
+static void fuzz_checkpoint(const char *ck_name, Checkpoint * ck, HammerSuite * suite,
+			    uint64_t t_start)
+{
+	if (ck_name == NULL)
+		return;
+	writer_flush();
 #ifdef FLIPTABLE
-		print_end_attack();
+	ck->off = g_ft->bytes;
+#else
+	fflush(out_fd);
+	ck->off = ftell(out_fd);
 #endif
-	}
-	fprintf(stdout, "\n");
-	free(h_patt.d_lst);
+	ck->rng = fuzz_rng;
+	ck->setup_cnt = suite->setup_off + suite->stats.setup_cnt;
+	ck->init_cnt = suite->init_off + suite->stats.init_cnt;
+	uint64_t elapsed = ck->elapsed_ns;
+	ck->elapsed_ns += ticks_2_ns(realtime_now() - t_start);
+	ckpt_save(ck_name, ck);
+	ck->elapsed_ns = elapsed;
+}
+
+static bool fuzz_budget_left(Checkpoint * ck, uint64_t t_start)
+{
+	const char *why = NULL;
+	if (g_stop)
+		why = g_stop == SIGINT ? "SIGINT" : "SIGTERM";
+	else if (p->max_patterns && ck->patterns >= p->max_patterns)
+		why = "--max-patterns";
+	else if (p->duration && ticks_2_ns(realtime_now() - t_start) >= p->duration * 1000000000UL)
+		why = "--duration";
+	if (why == NULL)
+		return true;
+
+	writer_sync();		// don't cut the last [HAMMER] line
+	fprintf(stderr, "[LOG] - Stopping after %ld patterns (%s)\n", ck->patterns, why);
+	return false;
 }
 
 void fuzzing_session(SessionConfig * cfg, MemoryBuffer * mem)
 {
-	int d, v, aggrs;
+	FuzzTuple t;
+	char *ck_name = NULL;
+	bool resumed = false;
+	Checkpoint ck;
+	memset(&ck, 0x00, sizeof(Checkpoint));
+	ck.seed = CL_SEED;
+	ck.rng = CL_SEED;
+	fz_init(&ck.fz, CL_SEED, p->bandit);
 
-	srand(CL_SEED);
 	DRAMAddr d_base = phys_2_dram(virt_2_phys(mem->buffer, mem));
 	fprintf(stdout, "[INFO] d_base.row:%lu\n", d_base.row);
 
@@ -809,8 +1791,8 @@ void fuzzing_session(SessionConfig * cfg, MemoryBuffer * mem)
 	strcat(out_name, rows_str);
 	strcat(out_name, ".");
 	strcat(out_name, REFRESH_VAL);
-	strcat(out_name, ".csv");
-	if (p->g_flags & F_NO_OVERWRITE) {
+	strcat(out_name, OUT_EXT);
+	if ((p->g_flags & F_NO_OVERWRITE) && !p->resume) {
 		int cnt = 0;
 		char *tmp_name = (char *)malloc(500);
 		strncpy(tmp_name, out_name, strlen(out_name));
@@ -821,23 +1803,108 @@ void fuzzing_session(SessionConfig * cfg, MemoryBuffer * mem)
 		strncpy(out_name, tmp_name, strlen(tmp_name));
 		free(tmp_name);
 	}
-	out_fd = fopen(out_name, "w+");
+	ck_name = (char *)malloc(strlen(out_name) + strlen(CKPT_EXT) + 1);
+	sprintf(ck_name, "%s%s", out_name, CKPT_EXT);
+	if (p->resume) {
+		resumed = ckpt_load(ck_name, &ck) == 0;
+		if (resumed && ck.seed != CL_SEED) {
+			fprintf(stderr, "[ERROR] - %s was taken with seed %lx\n", ck_name, ck.seed);
+			exit(1);
+		}
+		if (!resumed)
+			fprintf(stderr, "[LOG] - No checkpoint in %s, starting over\n", ck_name);
+	}
+#ifdef FLIPTABLE
+	if (resumed)
+		g_ft = ft_resume(out_name, ck.off);
+	else
+		g_ft = ft_open(out_name, get_dram_layout(), CL_SEED, cfg);
+#else
+	out_fd = fopen(out_name, resumed ? "r+" : "w+");
 	assert(out_fd != NULL);
+	if (resumed) {
+		assert(ftruncate(fileno(out_fd), ck.off) == 0);
+		fseek(out_fd, 0, SEEK_END);
+	}
+#endif
+	fprintf(stderr, "[LOG] - File: %s\n", out_name);
+	if (resumed)
+		fprintf(stderr, "[LOG] - Resuming after %ld patterns (%.1f h)\n", ck.patterns,
+			(double)ck.elapsed_ns / 3.6e12);
 	#endif
+	fuzz_rng = ck.rng;
+	ck.fz.bandit = p->bandit;
 
 	HammerSuite *suite = (HammerSuite *) malloc(sizeof(HammerSuite));
+	memset(suite, 0x00, sizeof(HammerSuite));
 	suite->mem = mem;
 	suite->cfg = cfg;
 	suite->d_base = d_base;
+	suite->setup_off = ck.setup_cnt;
+	suite->init_off = ck.init_cnt;
 	suite->mapper = (ADDRMapper *) malloc(sizeof(ADDRMapper));
+	uint64_t t0 = realtime_now();
 	init_addr_mapper(suite->mapper, mem, &suite->d_base, cfg->h_rows);
-
-	while(1) {
-		cfg->aggr_n = random_int(2, 32);
-		d = random_int(0, 16);
-		v = random_int(1, 4);
-		fuzz(suite, d, v);
+	print_time("mapper", realtime_now() - t0);
+	init_refresh(suite);
+	init_pool(suite);
+	writer_start(g_ft);
+
+	struct sigaction sa;
+	memset(&sa, 0x00, sizeof(struct sigaction));
+	sa.sa_handler = on_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	uint64_t t_start = realtime_now();
+	uint64_t t_ckpt = t_start;
+	while (fuzz_budget_left(&ck, t_start)) {
+		fz_next(&ck.fz, &t);
+		cfg->aggr_n = t.aggr_n;
+		uint64_t flips = suite->stats.flips;
+		uint64_t t_patt = realtime_now();
+		fuzz(suite, t.d, t.v, t.offset);
+		t_patt = ticks_2_ns(realtime_now() - t_patt);
+		flips = suite->stats.flips - flips;
+		fz_reward(&ck.fz, &t, flips, t_patt);
+		ck.patterns++;
+		if (flips && !ck.first_flip) {
+			ck.first_flip = ck.patterns;
+			ck.first_flip_ns = ck.elapsed_ns + ticks_2_ns(realtime_now() - t_start);
+			writer_sync();
+			fprintf(stderr, "[LOG] - First flip after %ld patterns, %.1f s\n", ck.first_flip,
+				ck.first_flip_ns / 1e9);
+		}
+		if ((p->g_flags & F_VERBOSE) && suite->stats.setup_cnt % STATS_EVERY == 0) {
+			writer_sync();
+			print_stats(suite);
+			fz_report(&ck.fz);
+		}
+		if (ck.patterns % CKPT_EVERY == 0 || ticks_2_ns(realtime_now() - t_ckpt) > CKPT_NS) {
+			fuzz_checkpoint(ck_name, &ck, suite, t_start);
+			t_ckpt = realtime_now();
+		}
 	}
+
+	fuzz_checkpoint(ck_name, &ck, suite, t_start);
+	writer_stop();
+	print_stats(suite);
+	fz_report(&ck.fz);
+#ifdef FLIPTABLE
+	ft_close(g_ft);
+	g_ft = NULL;
+#else
+	fclose(out_fd);
+#endif
+	tear_down_pool(suite);
+	free(suite->r_patt.v_lst);
+	free(suite->win.lst);
+	free(suite->dirty);
+	free(suite->sched);
+	jit_free(&suite->jit);
+	tear_down_addr_mapper(suite->mapper);
+	free(suite);
+	free(ck_name);
 }
 
 void hammer_session(SessionConfig * cfg, MemoryBuffer * memory)
@@ -872,7 +1939,7 @@ void hammer_session(SessionConfig * cfg, MemoryBuffer * memory)
 	strcat(out_name, rows_str);
 	strcat(out_name, ".");
 	strcat(out_name, REFRESH_VAL);
-	strcat(out_name, ".csv");
+	strcat(out_name, OUT_EXT);
 	if (p->g_flags & F_NO_OVERWRITE) {
 		int cnt = 0;
 		char *tmp_name = (char *)malloc(500);
@@ -884,7 +1951,11 @@ void hammer_session(SessionConfig * cfg, MemoryBuffer * memory)
 		strncpy(out_name, tmp_name, strlen(tmp_name));
 		free(tmp_name);
 	}
+#ifdef FLIPTABLE
+	g_ft = ft_open(out_name, get_dram_layout(), CL_SEED, cfg);
+#else
 	out_fd = fopen(out_name, "w+");
+#endif
 	fprintf(stderr, "[LOG] - File: %s\n", out_name);
 	#endif
 
@@ -893,12 +1964,18 @@ void hammer_session(SessionConfig * cfg, MemoryBuffer * memory)
 		config_str[cfg->h_cfg], data_str[cfg->d_cfg]);
 
 	HammerSuite *suite = (HammerSuite *) malloc(sizeof(HammerSuite));
+	memset(suite, 0x00, sizeof(HammerSuite));
 	suite->cfg = cfg;
 	suite->mem = &mem;
 	suite->d_base = d_base;
 	suite->mapper = (ADDRMapper *) malloc(sizeof(ADDRMapper));
 
+	uint64_t t0 = realtime_now();
 	init_addr_mapper(suite->mapper, &mem, &suite->d_base, cfg->h_rows);
+	print_time("mapper", realtime_now() - t0);
+	init_refresh(suite);
+	init_pool(suite);
+	writer_start(g_ft);
 
 	fprintf(stderr, "done mapping\n");
 #ifndef FLIPTABLE
@@ -931,7 +2008,20 @@ void hammer_session(SessionConfig * cfg, MemoryBuffer * memory)
 		}
 	}
 	suite->hammer_test(suite);
+	writer_stop();
+	print_stats(suite);
+#ifdef FLIPTABLE
+	ft_close(g_ft);
+	g_ft = NULL;
+#else
 	fclose(out_fd);
+#endif
+	tear_down_pool(suite);
+	free(suite->r_patt.v_lst);
+	free(suite->win.lst);
+	free(suite->dirty);
+	free(suite->sched);
+	jit_free(&suite->jit);
 	tear_down_addr_mapper(suite->mapper);
 	free(suite);
 }
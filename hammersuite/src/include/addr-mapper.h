@@ -3,20 +3,36 @@
 #include "memory.h"
 #include "types.h"
 #include "dram-address.h"
+#include "utils.h"
 
 typedef struct {
 	DRAMAddr d_addr;
 	char *v_addr;
 } DRAM_pte;
 
+/*
+ The translation is linear over GF(2), so the page offset of any cache line
+ is the offset of column 0 of its row XOR a delta that only depends on the
+ column. A row is then one 32-bit offset, and the column deltas are shared
+ by every row of the mapper.
+ */
 typedef struct {
-	DRAM_pte *lst;
+	char *v_base;		// virtual address of the 1GB page
+	uint32_t off;		// page offset of col 0
+	uint32_t *col_off;	// page offset delta of every cache line
 	size_t len;
 } RowMap;
 
+#define ROW_UNMAPPED	UINT32_MAX	// row offset not computed yet
+
 typedef struct {
+	MemoryBuffer *mem;
 	size_t base_row;	// used as an offset
-	RowMap *row_maps;
+	size_t rows;		// rows per bank
+	size_t bks;
+	char *v_base;		// virtual address of the 1GB page
+	uint32_t *row_off;	// page offset of col 0 of every (row, bank), filled on first use
+	uint32_t col_off[ROW_SIZE / CL_SIZE];
 } ADDRMapper;
 
 void init_addr_mapper(ADDRMapper * mapper, MemoryBuffer * mem,
@@ -24,3 +40,9 @@ void init_addr_mapper(ADDRMapper * mapper, MemoryBuffer * mem,
 RowMap get_row_map(ADDRMapper * mapper, DRAMAddr * d_addr);
 DRAM_pte get_dram_pte(ADDRMapper * mapper, DRAMAddr * d_addr);
 void tear_down_addr_mapper(ADDRMapper * mapper);
+
+// virtual address of cache line cl of the row
+static inline char *rmap_cl(RowMap * rmap, size_t cl)
+{
+	return rmap->v_base + (rmap->off ^ rmap->col_off[cl]);
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "types.h"
+
+int run_bench(const char *name);
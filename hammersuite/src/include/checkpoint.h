@@ -0,0 +1,35 @@
+#pragma once
+
+#include "types.h"
+#include "fuzz-sched.h"
+
+#define CKPT_MAGIC	"TRRCKPT"
+#define CKPT_VERSION	4
+#define CKPT_EXT	".ckpt"
+#define CKPT_EVERY	100		// fuzzed patterns between checkpoints
+#define CKPT_NS		60000000000UL	// checkpoint at least once a minute
+
+/*
+ State of a fuzzing session, saved next to its output file. A resumed
+ session truncates the output back to off and continues the fuzzer PRNG
+ and tuple schedule, so it produces the patterns the lost run would have
+ produced.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t pad;
+	uint64_t seed;		// CL_SEED of the random data
+	uint64_t rng;		// fuzzer PRNG state
+	uint64_t patterns;	// fuzzed patterns
+	uint64_t off;		// bytes of the output file covered by the checkpoint
+	uint64_t elapsed_ns;	// fuzzing time of all runs so far
+	uint64_t first_flip;	// patterns up to the first flip, 0 = none yet
+	uint64_t first_flip_ns;
+	uint64_t setup_cnt;	// cadence of --full-scan
+	uint64_t init_cnt;	// cadence of --refresh-every
+	FuzzSched fz;
+} Checkpoint;
+
+int ckpt_load(const char *f_name, Checkpoint * ck);
+void ckpt_save(const char *f_name, Checkpoint * ck);
@@ -23,11 +23,16 @@ typedef struct {
 	uint64_t col;
 } DRAMAddr;
 
+void init_dram_xlate();
 physaddr_t dram_2_phys(DRAMAddr d_addr, MemoryBuffer *mem);
 DRAMAddr phys_2_dram(physaddr_t p_addr);
+void dram_2_phys_batch(DRAMAddr *d_lst, physaddr_t *p_lst, size_t len, MemoryBuffer *mem);
+void phys_2_dram_batch(physaddr_t *p_lst, DRAMAddr *d_lst, size_t len);
 char *dram_2_str(DRAMAddr * d_addr);
 char *dramLayout_2_str(DRAMLayout * mem_layout);
 DRAMLayout *get_dram_layout();
+void load_dram_layout(const char *f_name);
+int save_dram_layout(const char *f_name, DRAMLayout * layout);
 uint64_t get_banks_cnt();
 bool d_addr_eq(DRAMAddr * d1, DRAMAddr * d2);
 bool d_addr_eq_row(DRAMAddr * d1, DRAMAddr * d2);
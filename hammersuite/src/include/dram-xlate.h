@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+#include "dram-address.h"
+
+#define XL_BYTES	8	// byte slices of a 64-bit value
+
+/*
+ Row or column field of a DRAMLayout. gather/scatter are the byte-sliced
+ equivalent of PEXT/PDEP with mask, used when BMI2 is not available.
+ */
+typedef struct {
+	uint64_t mask;			// physical bits of the field
+	int lo, hi;			// byte slices of mask
+	int bits;			// width of the packed field
+	uint64_t gather[XL_BYTES][256];	// phys byte -> packed field bits
+	uint64_t scatter[XL_BYTES][256];	// packed byte -> phys bits
+} BitField;
+
+/*
+ A DRAMLayout compiled into GF(2) matrices.
+ Forward:	bank bit i = parity(p & fns[i]), row/col = gather(p)
+ Inverse:	p = scatter(row) ^ scatter(col), then the bank bits are fixed
+		with bank_fix[], a phys vector for every bank difference that
+		leaves row and col untouched.
+ */
+typedef struct {
+	uint64_t fns[HASH_FN_CNT];
+	uint64_t len;
+	BitField row;
+	BitField col;
+	physaddr_t bank_fix[1 << HASH_FN_CNT];
+	bool bmi2;			// use PEXT/PDEP instead of the tables
+	bool avx2;			// 4-lane parity in the batch calls
+} DRAMXlate;
+
+int xlate_compile(DRAMXlate * xl, DRAMLayout * layout);
+int xlate_self_test(DRAMXlate * xl, DRAMLayout * layout, size_t samples);
+DRAMAddr xlate_fwd(DRAMXlate * xl, physaddr_t p_addr);
+physaddr_t xlate_inv(DRAMXlate * xl, DRAMAddr d_addr);
+void xlate_fwd_batch(DRAMXlate * xl, physaddr_t * p_lst, DRAMAddr * d_lst, size_t len);
+void xlate_inv_batch(DRAMXlate * xl, DRAMAddr * d_lst, physaddr_t * p_lst, size_t len);
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "types.h"
+#include "dram-address.h"
+
+#define FT_MAGIC	"TRRFLIP"
+#define FT_VERSION	3		// 2: FT_PATT rounds, FT_FIRST and FT_TIME records, 3: FT_FREQ
+#define FT_BUF_RECS	(1 << 16)	// records buffered before a write()
+#define FT_FLUSH_NS	1000000000UL	// flush at least once a second
+
+/*
+ Binary fliptable. A FTHeader, then a stream of fixed-size FTRecords:
+ every pattern is a FT_PATT record followed by one FT_AGGR record per
+ aggressor row and the FT_FLIP records of all its banks, in bank order.
+ A bank stopped early by --chunk starts with a FT_FIRST record, every bank
+ ends with a FT_TIME record.
+ Banks without flips take no space, `tester --convert` rebuilds the text
+ fliptable from the bank count of the layout.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+	DRAMLayout layout;
+	uint64_t seed;		// CL_SEED of the random data
+	SessionConfig cfg;
+} FTHeader;
+
+typedef enum {
+	FT_PATT = 1,
+	FT_AGGR,
+	FT_FLIP,
+	FT_FIRST,		// bank stopped at its first flip, see --chunk
+	FT_TIME,		// hammer time and ACT rate of a bank
+} FTType;
+
+#define FT_TABLE	1	// FT_PATT flag: one text line per bank
+#define FT_FREQ		2	// FT_PATT flag: the FT_AGGR records hold the AggrFreq of --freq
+
+typedef struct {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t f_og;
+	uint8_t f_new;
+	uint16_t bank;
+	uint16_t col;		// FT_AGGR: phase, FT_TIME: ns on top of row
+	uint32_t row;		// FT_PATT: rounds, FT_FIRST: us of hammering up to the flip, FT_TIME: us
+	uint32_t val;		// FT_PATT: aggressors, FT_AGGR: freq << 16 | amp, FT_FIRST: activations,
+				// FT_TIME: activations/s
+} FTRecord;
+
+typedef struct {
+	int fd;
+	FTRecord *buf;
+	size_t len;		// records in buf
+	uint64_t t_flush;	// last write()
+	uint64_t writes;
+	uint64_t bytes;		// file size, header included
+} FlipTable;
+
+/* Records of a single bank, appended to the FlipTable in bank order. */
+typedef struct {
+	FTRecord *rec;
+	size_t len;
+	size_t cap;
+} FTBuffer;
+
+FlipTable *ft_open(const char *f_name, DRAMLayout * layout, uint64_t seed,
+		   SessionConfig * cfg);
+FlipTable *ft_resume(const char *f_name, uint64_t off);
+void ft_push(FlipTable * ft, FTRecord * rec, size_t n);
+void ft_flush(FlipTable * ft);
+void ft_close(FlipTable * ft);
+void ft_buf_push(FTBuffer * buf, FTRecord * rec);
+int ft_convert(const char *f_name, FILE * out);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "types.h"
+
+/* Parameter space of fuzz(), [min, max) like random_int() */
+#define FZ_AGGR_MIN	2
+#define FZ_AGGR_MAX	32
+#define FZ_D_MIN	0
+#define FZ_D_MAX	16
+#define FZ_V_MIN	1
+#define FZ_V_MAX	4
+#define FZ_OFF_MIN	1
+#define FZ_OFF_MAX	32
+
+#define FZ_TUPLES	((FZ_AGGR_MAX - FZ_AGGR_MIN) * (FZ_D_MAX - FZ_D_MIN) * \
+			 (FZ_V_MAX - FZ_V_MIN) * (FZ_OFF_MAX - FZ_OFF_MIN))
+#define FZ_BITS		16		// Feistel domain, 2^FZ_BITS >= FZ_TUPLES
+#define FZ_ROUNDS	4
+#define FZ_EXPLORE	0.1		// share of uniform picks with --bandit
+#define FZ_UCB_C	1.0		// weight of the UCB exploration term
+
+typedef struct {
+	int aggr_n;
+	int d;
+	int v;
+	int offset;
+} FuzzTuple;
+
+typedef struct {
+	uint64_t pulls;
+	uint64_t flips;
+	uint64_t ns;		// time spent on patterns with this arm
+} FuzzArm;
+
+/*
+ UCB1 over each dimension of the tuple, rewarded with the flips/s of the
+ pattern. Arms are scored with their rate relative to the best arm of the
+ dimension, so the score doesn't depend on how vulnerable the DIMM is.
+ */
+typedef struct {
+	FuzzArm aggr[FZ_AGGR_MAX - FZ_AGGR_MIN];
+	FuzzArm d[FZ_D_MAX - FZ_D_MIN];
+	FuzzArm v[FZ_V_MAX - FZ_V_MIN];
+	uint64_t pulls;
+	uint64_t explore;	// uniform picks
+} FuzzBandit;
+
+/*
+ Walks the tuples in a seeded random order without repeats. bits keeps
+ the tuples of the current pass, once all of them are tested a new pass
+ starts over with a different order. With bandit set, the walk only
+ supplies the FZ_EXPLORE share of uniform picks.
+ */
+typedef struct {
+	uint64_t seed;
+	uint64_t pass;
+	uint64_t idx;		// position in the permutation of this pass
+	uint64_t tested;	// bits set in bits
+	uint64_t bits[(FZ_TUPLES + 63) / 64];
+	uint64_t rng;		// PRNG state of the bandit
+	int bandit;		// pick tuples with bd, see fz_next()
+	FuzzBandit bd;
+} FuzzSched;
+
+void fz_init(FuzzSched * fz, uint64_t seed, int bandit);
+void fz_next(FuzzSched * fz, FuzzTuple * t);
+void fz_reward(FuzzSched * fz, FuzzTuple * t, uint64_t flips, uint64_t ns);
+void fz_report(FuzzSched * fz);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "types.h"
+
+#define JIT_REGS	12		// aggressors kept in registers, the others are reloaded
+#define JIT_OP_BYTES	24		// upper bound of the code of a single op
+
+typedef enum {
+	JIT_ACCESS = 1,		// load a byte of aggressor arg
+	JIT_FLUSH,		// clflushopt aggressor arg
+	JIT_FENCE,		// mfence
+	JIT_NOP,		// arg nops
+	JIT_IDLE,		// arg iterations of the spin() loop
+} JitOpType;
+
+typedef struct {
+	uint16_t type;
+	uint16_t arg;
+} JitOp;
+
+/* v_lst: aggressor addresses of a bank, iters: runs of the schedule */
+typedef void (*JitFn) (char **v_lst, uint64_t iters);
+
+/*
+ Access schedule and the straight-line code compiled from it. The code
+ only depends on the aggressor indices, so a kernel serves every bank.
+ Both buffers only grow.
+ */
+typedef struct {
+	JitOp *ops;
+	size_t n_ops;
+	size_t ops_cap;
+	uint8_t *code;		// mmap()ed, executable once compiled
+	size_t len;
+	size_t cap;
+} JitKernel;
+
+void jit_reset(JitKernel * k);
+void jit_op(JitKernel * k, JitOpType type, uint16_t arg);
+JitFn jit_compile(JitKernel * k, size_t n_aggr);
+void jit_free(JitKernel * k);
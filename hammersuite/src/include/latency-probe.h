@@ -0,0 +1,28 @@
+#pragma once
+
+#include "types.h"
+#include "memory.h"
+
+#define LP_ROWS		256		// rows per bank the pairs are drawn from
+#define LP_LOG_BINS	64
+#define LP_BIN		4		// cycles per linear bin
+#define LP_BINS		1024		// the last linear bin takes the outliers
+#define LP_MIN_GAP	1.15		// row conflicts slower than other banks by at least this
+#define LP_EXT		".latency.csv"
+
+typedef enum {
+	LP_SAME_ROW,		// two columns of a row: row hit
+	LP_OTHER_BANK,		// two banks
+	LP_CONFLICT,		// two rows of a bank: row conflict
+	LP_KINDS,
+} ProbeKind;
+
+/* Latency of a pair of accesses of one kind, in rdtscp() cycles. */
+typedef struct {
+	uint64_t log2[LP_LOG_BINS];	// bin i: [2^i, 2^(i+1))
+	uint64_t lin[LP_BINS];		// bin i: [i * LP_BIN, (i + 1) * LP_BIN)
+	uint64_t samples;
+	uint64_t sum;
+} ProbeHist;
+
+int latency_probe(MemoryBuffer * mem, size_t samples);
@@ -18,6 +18,10 @@
 #define ALIGN_std       2<<20
 #define PATT_LEN 		1024
 #define AGGR_std		9
+#define VICT_WIN_std	8		// victim rows scanned on each side of an aggressor
+#define FULL_SCAN_std	100		// patterns between full h_rows sweeps
+#define MAX_THREADS		64
+#define REFRESH_std		100		// init_chunk() calls between full rewrites
 #define HUGE_YES
 
 // Each set of defines below should have only the correct value set to 1, and all others in the set 0. This avoids issues when compiling with functions not available to certain setups.
@@ -37,6 +41,27 @@ typedef struct ProfileParams {
 	int		 huge_fd;
 	char     *conf_file		= (char *)CONFIG_NAME_std;
 	int 	 aggr			= AGGR_std;
+	char	*bench			= (char *)NULL;	// run a microbenchmark and exit
+	char	*convert		= (char *)NULL;	// print a binary fliptable as text and exit
+	size_t	 vict_win		= VICT_WIN_std;	// 0 scans all h_rows
+	size_t	 full_scan		= FULL_SCAN_std;	// 0 never sweeps all h_rows
+	size_t	 threads		= 1;		// worker threads
+	size_t	 refresh_every	= REFRESH_std;	// 0 rewrites only dirty rows
+	int		 pipeline		= 0;		// overlap hammer and fill/scan of other banks
+	int		 serialize		= 0;		// run the pipeline stages one after the other
+	size_t	 duration		= 0;		// fuzzing budget of this run in seconds, 0 = none
+	size_t	 max_patterns	= 0;		// fuzzing budget over all runs, 0 = none
+	int		 resume			= 0;		// continue the fuzzing session from its checkpoint
+	int		 bandit			= 0;		// steer the fuzzer towards productive tuples
+	int		 freq			= 0;		// fuzz non-uniform (frequency-domain) patterns
+	int		 jit			= 0;		// compile the hammer loop of every pattern
+	size_t	 jit_nops		= 0;		// NOPs after every access of a compiled pattern
+	size_t	 chunk			= 0;		// rounds between flip checks, 0 = hammer all rounds
+	size_t	 auto_rounds	= 0;		// refresh windows per pattern, 0 = fixed h_rounds
+	int		 refresh_sync	= 0;		// detect the refresh stalls, -t takes precedence
+	size_t	 refresh_phase	= 0;		// start of hammering in % of tREFI after a stall
+	size_t	 latency_probe	= 0;		// access pairs per kind timed by --latency-probe, 0 = off
+	char	*layout			= (char *)NULL;	// DRAMLayout file, loaded by the tester, written by drama
 } ProfileParams;
 
 int process_argv(int argc, char *argv[], ProfileParams *params);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "types.h"
+
+#define RF_SAMPLES	(1 << 17)	// latency samples of refresh_detect()
+#define RF_BIN		8		// cycles per histogram bin
+#define RF_BINS		512
+#define RF_MIN_STALLS	32		// stalls needed to trust the period
+#define RF_TIMEOUT	4		// periods refresh_wait() waits for a stall
+
+/*
+ Refresh stalls seen from a single address. Every sample loads and flushes
+ the address, samples slower than threshold overlapped a refresh and their
+ start times give the tREFI period. Times are in rdtscp() cycles.
+ */
+typedef struct {
+	uint64_t hist[RF_BINS];	// sample latency, RF_BIN cycles per bin
+	uint64_t samples;
+	uint64_t stalls;	// runs of samples above threshold
+	uint64_t threshold;	// 0 = no refresh detected
+	uint64_t period;	// tREFI, 0 waits for any stall without a phase
+	uint64_t jitter;	// median deviation of the stall intervals
+	uint64_t offset;	// cycles from a stall to the start of hammering
+	double ns_per_cycle;
+} RefreshDet;
+
+int refresh_detect(RefreshDet * rd, volatile char *addr);
+bool refresh_wait(RefreshDet * rd, volatile char *addr);
+void refresh_report(RefreshDet * rd);
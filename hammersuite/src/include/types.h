@@ -44,6 +44,14 @@ typedef struct {
 	int	   aggr_n;
 } SessionConfig;
 
+/*	filled once by set_physmap() so that virt<->phys translations
+	of the buffer never have to go back to /proc/self/pagemap. */
+typedef struct {
+	physaddr_t p_base;	// physical address of buffer
+	size_t pages;		// entries in physmap
+	bool contig;		// buffer is physically contiguous
+} XlateCtx;
+
 typedef struct {
 	char *buffer;		// base addr
 	pte_t *physmap;		// list of virt<->phys mapping for every page
@@ -51,4 +59,15 @@ typedef struct {
 	uint64_t size;		// in bytes
 	uint64_t align;
 	uint64_t flags;		// from params
+	XlateCtx xlate;		// cached translation context
 } MemoryBuffer;
+
+/*
+ Frequency-domain aggressor: freq occurrences every FREQ_PERIOD slots, the
+ first one at slot phase, each accessing the row amp times in a row.
+ */
+typedef struct {
+	uint16_t freq;
+	uint16_t phase;
+	uint16_t amp;
+} AggrFreq;
@@ -1,6 +1,7 @@
 #pragma once
 
-#include <stdint>
+#include <stdint.h>
+#include <arm_neon.h>
 
 #include "dram-address.h"
 #include "params.h"
@@ -74,6 +75,61 @@ void clflushopt(volatile void *p)
 	return;
 }
 
+/**
+Inputs: eq0..eq3 - byte compare results (0xff/0x00) of 64 consecutive bytes
+
+NEON has no movemask. Weight every byte with its bit position and add pairwise
+until the 64 bits end up in the low lane.
+
+Output: mask with bit i set if byte i compared equal
+*/
+static inline __attribute__ ((always_inline))
+uint64_t neon_movemask64(uint8x16_t eq0, uint8x16_t eq1, uint8x16_t eq2, uint8x16_t eq3)
+{
+	const uint8x16_t bits = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t m01 = vpaddq_u8(vandq_u8(eq0, bits), vandq_u8(eq1, bits));
+	uint8x16_t m23 = vpaddq_u8(vandq_u8(eq2, bits), vandq_u8(eq3, bits));
+	uint8x16_t m = vpaddq_u8(m01, m23);
+	m = vpaddq_u8(m, m);
+	return vgetq_lane_u64(vreinterpretq_u64_u8(m), 0);
+}
+
+/**
+Inputs: a, b - the cache lines to compare
+
+Compares two cache lines 16 bytes at a time.
+
+Output: mask with bit i set if byte i of the cache lines differs
+*/
+static inline __attribute__ ((always_inline))
+uint64_t cl_diff(const char *a, const char *b)
+{
+	const uint8_t *ua = (const uint8_t *)a, *ub = (const uint8_t *)b;
+	return ~neon_movemask64(vceqq_u8(vld1q_u8(ua), vld1q_u8(ub)),
+				vceqq_u8(vld1q_u8(ua + 16), vld1q_u8(ub + 16)),
+				vceqq_u8(vld1q_u8(ua + 32), vld1q_u8(ub + 32)),
+				vceqq_u8(vld1q_u8(ua + 48), vld1q_u8(ub + 48)));
+}
+
+/**
+Inputs: a - the cache line to compare
+        val - the expected value of every byte
+
+Same as cl_diff, against a cache line filled with val.
+
+Output: mask with bit i set if byte i of the cache line isn't val
+*/
+static inline __attribute__ ((always_inline))
+uint64_t cl_diff_val(const char *a, uint8_t val)
+{
+	const uint8_t *ua = (const uint8_t *)a;
+	uint8x16_t vb = vdupq_n_u8(val);
+	return ~neon_movemask64(vceqq_u8(vld1q_u8(ua), vb),
+				vceqq_u8(vld1q_u8(ua + 16), vb),
+				vceqq_u8(vld1q_u8(ua + 32), vb),
+				vceqq_u8(vld1q_u8(ua + 48), vb));
+}
+
 /**
 Inputs: none
 
@@ -126,6 +182,19 @@ void lfence()
 	asm volatile ("DSB SY");
 }
 
+/**
+Inputs: n - iterations, at least 1
+
+Busy loop of n subs/b.ne iterations.
+
+Output: None
+*/
+static inline __attribute__ ((always_inline))
+void spin(uint32_t n)
+{
+	asm volatile ("1: subs %w0, %w0, #1\n\tb.ne 1b\n":"+r" (n)::"cc");
+}
+
 /**
 Inputs: none
 
@@ -152,6 +221,28 @@ uint64_t rdtsc(void)
 	return read_64pmccntr();
 }
 
+/**
+Inputs: a, b - the two addresses
+
+Times an access to a and then to b, both flushed first. The lfence keeps
+the two loads from overlapping, so a row conflict adds its full latency.
+
+Output: cycles of the two accesses
+*/
+static inline __attribute__ ((always_inline))
+uint64_t time_pair(volatile char *a, volatile char *b)
+{
+	clflushopt(a);
+	clflushopt(b);
+	mfence();
+	uint64_t t0 = rdtscp();
+	*a;
+	lfence();
+	*b;
+	uint64_t t1 = rdtscp();
+	return t1 - t0;
+}
+
 /**
 Inputs: none
 
@@ -175,7 +266,7 @@ Output: the buffer of randomized values
 static inline __attribute((always_inline))
 char *cl_rand_gen(DRAMAddr * d_addr, uint64_t CL_SEED)
 {
-	static uint64_t cl_buff[8];
+	static __thread uint64_t cl_buff[8];
 	for (int i = 0; i < 8; i++) {
 		cl_buff[i] =
 			__builtin_aarch64_crc32b(CL_SEED,
@@ -185,13 +276,45 @@ char *cl_rand_gen(DRAMAddr * d_addr, uint64_t CL_SEED)
 	return (char *)cl_buff;
 }
 
-uint64_t build_buffer(MemoryBuffer* mem);
+/**
+Inputs: dst - the cache line to fill
+        d_addr - DRAM address of the cache line
+        CL_SEED - seed of the CRC
 
-int tear_down_buff(MemoryBuffer* mem);
+Writes the same values as cl_rand_gen straight to dst. DIFF: plain stores, the
+caches are disabled on the board anyway.
 
-uint64_t get_dram_col(physaddr_t p_addr, DRAMLayout g_mem_layout);
+Output: None
+*/
+static inline __attribute((always_inline))
+void cl_rand_stream(char *dst, DRAMAddr * d_addr, uint64_t CL_SEED)
+{
+	uint64_t key = d_addr->row + d_addr->bank + d_addr->col;
+	uint64_t *q = (uint64_t *)dst;
+	for (int i = 0; i < 8; i++)
+		q[i] = __builtin_aarch64_crc32b(CL_SEED, key + i*8);
+}
+
+/**
+Inputs: dst - the cache line to fill
+        val - the value of every byte
 
-physaddr_t col_2_phys(DRAMAddr d_addr, DRAMLayout g_mem_layout);
+memset of a cache line. DIFF: plain stores, see cl_rand_stream.
+
+Output: None
+*/
+static inline __attribute((always_inline))
+void cl_val_stream(char *dst, uint8_t val)
+{
+	uint64_t v = 0x0101010101010101ULL * val;
+	uint64_t *q = (uint64_t *)dst;
+	for (int i = 0; i < 8; i++)
+		q[i] = v;
+}
+
+uint64_t build_buffer(MemoryBuffer* mem);
+
+int tear_down_buff(MemoryBuffer* mem);
 
 void gmem_dump_helper(DRAMLayout g_mem_layout);
 
@@ -208,6 +331,8 @@ char* phys_2_virt_helper(physaddr_t p_addr, MemoryBuffer* mem);
 
 void sched_yield_helper();
 
+void pin_thread(int cpu);
+
 void manually_fill_params(ProfileParams* p);
 
 void create_dir(const char* dir_name);
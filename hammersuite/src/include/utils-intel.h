@@ -1,6 +1,7 @@
 #pragma once
 
-#include <stdint>
+#include <stdint.h>
+#include <immintrin.h>
 
 #include "dram-address.h"
 #include "params.h"
@@ -35,6 +36,55 @@ void clflushopt(volatile void *p)
 #endif
 }
 
+/**
+Inputs: a, b - the cache lines to compare
+
+Compares two cache lines 16 (32 with AVX2) bytes at a time.
+
+Output: mask with bit i set if byte i of the cache lines differs
+*/
+static inline __attribute__ ((always_inline))
+uint64_t cl_diff(const char *a, const char *b)
+{
+#ifdef __AVX2__
+	uint64_t eq_lo = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		_mm256_loadu_si256((const __m256i *)a),
+		_mm256_loadu_si256((const __m256i *)b)));
+	uint64_t eq_hi = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+		_mm256_loadu_si256((const __m256i *)(a + 32)),
+		_mm256_loadu_si256((const __m256i *)(b + 32))));
+	return ~(eq_lo | (eq_hi << 32));
+#else
+	uint64_t eq = 0;
+	for (int i = 0; i < 4; i++) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + 16 * i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + 16 * i));
+		eq |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) << (16 * i);
+	}
+	return ~eq;
+#endif
+}
+
+/**
+Inputs: a - the cache line to compare
+        val - the expected value of every byte
+
+Same as cl_diff, against a cache line filled with val.
+
+Output: mask with bit i set if byte i of the cache line isn't val
+*/
+static inline __attribute__ ((always_inline))
+uint64_t cl_diff_val(const char *a, uint8_t val)
+{
+	__m128i vb = _mm_set1_epi8(val);
+	uint64_t eq = 0;
+	for (int i = 0; i < 4; i++) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + 16 * i));
+		eq |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) << (16 * i);
+	}
+	return ~eq;
+}
+
 /**
 Inputs: none
 
@@ -87,6 +137,19 @@ void lfence()
 	asm volatile ("lfence":::"memory");
 }
 
+/**
+Inputs: n - iterations, at least 1
+
+Busy loop of n dec/jnz iterations, the same loop as JIT_IDLE.
+
+Output: None
+*/
+static inline __attribute__ ((always_inline))
+void spin(uint32_t n)
+{
+	asm volatile ("1: dec %0\n\tjnz 1b\n":"+r" (n));
+}
+
 /**
 Inputs: none
 
@@ -119,6 +182,28 @@ uint64_t rdtsc(void)
 	return (hi << 32) | lo;
 }
 
+/**
+Inputs: a, b - the two addresses
+
+Times an access to a and then to b, both flushed first. The lfence keeps
+the two loads from overlapping, so a row conflict adds its full latency.
+
+Output: cycles of the two accesses
+*/
+static inline __attribute__ ((always_inline))
+uint64_t time_pair(volatile char *a, volatile char *b)
+{
+	clflushopt(a);
+	clflushopt(b);
+	mfence();
+	uint64_t t0 = rdtscp();
+	*a;
+	lfence();
+	*b;
+	uint64_t t1 = rdtscp();
+	return t1 - t0;
+}
+
 /**
 Inputs: none
 
@@ -144,7 +229,7 @@ Output: the buffer of randomized values
 static inline __attribute((always_inline))
 char *cl_rand_gen(DRAMAddr * d_addr, uint64_t CL_SEED)
 {
-	static uint64_t cl_buff[8];
+	static __thread uint64_t cl_buff[8];
 	for (int i = 0; i < 8; i++) {
 		cl_buff[i] =
 			__builtin_ia32_crc32di(CL_SEED,
@@ -154,13 +239,47 @@ char *cl_rand_gen(DRAMAddr * d_addr, uint64_t CL_SEED)
 	return (char *)cl_buff;
 }
 
-uint64_t build_buffer(MemoryBuffer* mem);
+/**
+Inputs: dst - the cache line to fill
+        d_addr - DRAM address of the cache line
+        CL_SEED - seed of the CRC
 
-int tear_down_buff(MemoryBuffer* mem);
+Writes the same values as cl_rand_gen with non-temporal stores, so the line goes
+to memory without polluting the cache or needing a flush. The eight CRCs don't
+depend on each other and are all in flight at once. Needs an sfence before the
+data is read back.
 
-uint64_t get_dram_col(physaddr_t p_addr, DRAMLayout g_mem_layout);
+Output: None
+*/
+static inline __attribute((always_inline))
+void cl_rand_stream(char *dst, DRAMAddr * d_addr, uint64_t CL_SEED)
+{
+	uint64_t key = d_addr->row + d_addr->bank + d_addr->col;
+	long long *q = (long long *)dst;
+	for (int i = 0; i < 8; i++)
+		_mm_stream_si64(q + i, __builtin_ia32_crc32di(CL_SEED, key + i*8));
+}
+
+/**
+Inputs: dst - the cache line to fill
+        val - the value of every byte
+
+memset of a cache line with non-temporal stores. Needs an sfence before the data
+is read back.
+
+Output: None
+*/
+static inline __attribute((always_inline))
+void cl_val_stream(char *dst, uint8_t val)
+{
+	__m128i v = _mm_set1_epi8(val);
+	for (int i = 0; i < 4; i++)
+		_mm_stream_si128((__m128i *)(dst + 16 * i), v);
+}
 
-physaddr_t col_2_phys(DRAMAddr d_addr, DRAMLayout g_mem_layout);
+uint64_t build_buffer(MemoryBuffer* mem);
+
+int tear_down_buff(MemoryBuffer* mem);
 
 void gmem_dump_helper(DRAMLayout g_mem_layout);
 
@@ -177,6 +296,8 @@ char* phys_2_virt_helper(physaddr_t p_addr, MemoryBuffer* mem);
 
 void sched_yield_helper();
 
+void pin_thread(int cpu);
+
 void manually_fill_params(ProfileParams* p);
 
 void create_dir(const char* dir_name);
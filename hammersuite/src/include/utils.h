@@ -60,6 +60,12 @@ double mean(uint64_t * vals, size_t size);
 
 uint64_t median(uint64_t * vals, size_t size);
 
+size_t otsu_split(const uint64_t * hist, size_t bins);
+
+double calib_clock();
+
+uint64_t ticks_2_ns(uint64_t ticks);
+
 char *bit_string(uint64_t val);
 
 char *int_2_bin(uint64_t val);
@@ -68,14 +74,12 @@ char *get_rnd_addr(char *base, size_t m_size, size_t align);
 
 int get_rnd_int(int min, int max);
 
+void print_time(const char *what, uint64_t ticks);
+
 uint64_t build_buffer(MemoryBuffer* mem);
 
 int tear_down_buff(MemoryBuffer* mem);
 
-uint64_t get_dram_col(physaddr_t p_addr, DRAMLayout g_mem_layout);
-
-physaddr_t col_2_phys(DRAMAddr d_addr, DRAMLayout g_mem_layout);
-
 void set_physmap_helper(MemoryBuffer* mem);
 
 void gmem_dump_helper(DRAMLayout g_mem_layout);
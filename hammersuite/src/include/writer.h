@@ -0,0 +1,43 @@
+#pragma once
+
+#include "types.h"
+#include "dram-address.h"
+#include "fliptable.h"
+
+#define RING_SIZE	(1 << 16)	// events, power of 2
+#define WRITER_IDLE_US	100		// writer sleep when the ring is empty
+
+typedef enum {
+	EV_REC = 1,		// fliptable record
+	EV_EOL,			// end of the [HAMMER] line of a pattern
+} EventType;
+
+typedef struct {
+	uint32_t type;
+	uint32_t pad;
+	FTRecord rec;
+} Event;
+
+/*
+ Single-producer/single-consumer ring between the hammering path and the
+ writer thread. Only one thread produces at a time; the producer role can
+ move between threads across a barrier (pool workers, pipeline helper).
+ */
+typedef struct {
+	Event *ev;
+	uint64_t head __attribute__ ((aligned(64)));	// next slot to write, producer
+	uint64_t tail __attribute__ ((aligned(64)));	// next slot to read, consumer
+	uint64_t waits __attribute__ ((aligned(64)));	// pushes that found the ring full
+	uint64_t dropped;	// EV_EOL lost to a full ring
+	uint64_t events;
+} EventRing;
+
+void writer_start(FlipTable * ft);
+void writer_sync();
+void writer_flush();
+void writer_stop();
+void writer_report();
+void out_record(FTRecord * rec);
+void out_pattern(DRAMAddr * d_lst, AggrFreq * f_lst, size_t len, size_t rounds, bool table);
+void out_time(size_t bk, uint64_t ns, uint64_t acts);
+void out_eol();
@@ -0,0 +1,227 @@
+#include "jit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "utils.h"
+
+void jit_reset(JitKernel * k)
+{
+	k->n_ops = 0;
+}
+
+void jit_op(JitKernel * k, JitOpType type, uint16_t arg)
+{
+	if (k->n_ops == k->ops_cap) {
+		k->ops_cap = k->ops_cap ? k->ops_cap * 2 : 256;
+		k->ops = (JitOp *) realloc(k->ops, sizeof(JitOp) * k->ops_cap);
+		assert(k->ops != NULL);
+	}
+	k->ops[k->n_ops].type = type;
+	k->ops[k->n_ops].arg = arg;
+	k->n_ops++;
+}
+
+void jit_free(JitKernel * k)
+{
+	free(k->ops);
+	if (k->code)
+		munmap(k->code, k->cap);
+	memset(k, 0x00, sizeof(JitKernel));
+}
+
+#if defined NUC && defined __x86_64__
+
+enum { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// rax is the scratch register, rdi holds v_lst and rsi the iterations
+static const int aggr_regs[JIT_REGS] = { RBX, RBP, R12, R13, R14, R15, RDX, RCX, R8, R9, R10, R11 };
+static const int saved_regs[] = { RBX, RBP, R12, R13, R14, R15 };
+
+#define SAVED_CNT	(sizeof(saved_regs) / sizeof(int))
+
+static void emit8(JitKernel * k, uint8_t b)
+{
+	k->code[k->len++] = b;
+}
+
+static void emit32(JitKernel * k, uint32_t v)
+{
+	memcpy(&k->code[k->len], &v, sizeof(uint32_t));
+	k->len += sizeof(uint32_t);
+}
+
+// ModRM (+ SIB/disp8) of [base] with reg in the reg field
+static void emit_mem(JitKernel * k, int reg, int base)
+{
+	int b = base & 7;
+	if (b == RBP) {		// rbp/r13 need a displacement
+		emit8(k, 0x40 | (reg << 3) | b);
+		emit8(k, 0x00);
+	} else if (b == RSP) {	// rsp/r12 need a SIB byte
+		emit8(k, (reg << 3) | b);
+		emit8(k, 0x24);
+	} else {
+		emit8(k, (reg << 3) | b);
+	}
+}
+
+// mov reg, [rdi + 8 * idx]
+static void emit_load_addr(JitKernel * k, int reg, int idx)
+{
+	emit8(k, 0x48 | (reg >= R8 ? 0x04 : 0x00));
+	emit8(k, 0x8b);
+	emit8(k, 0x80 | ((reg & 7) << 3) | RDI);
+	emit32(k, 8 * idx);
+}
+
+// register holding the address of aggressor idx
+static int aggr_reg(JitKernel * k, int idx)
+{
+	if (idx < JIT_REGS)
+		return aggr_regs[idx];
+	emit_load_addr(k, RAX, idx);
+	return RAX;
+}
+
+static void emit_op(JitKernel * k, JitOp * op)
+{
+	int reg;
+	switch (op->type) {
+	case JIT_ACCESS:	// movzx eax, byte [reg]
+		reg = aggr_reg(k, op->arg);
+		if (reg >= R8)
+			emit8(k, 0x41);
+		emit8(k, 0x0f);
+		emit8(k, 0xb6);
+		emit_mem(k, RAX, reg);
+		break;
+	case JIT_FLUSH:		// clflushopt [reg]
+		reg = aggr_reg(k, op->arg);
+		emit8(k, 0x66);
+		if (reg >= R8)
+			emit8(k, 0x41);
+		emit8(k, 0x0f);
+		emit8(k, 0xae);
+		emit_mem(k, 7, reg);
+		break;
+	case JIT_FENCE:		// mfence
+		emit8(k, 0x0f);
+		emit8(k, 0xae);
+		emit8(k, 0xf0);
+		break;
+	case JIT_NOP:
+		memset(&k->code[k->len], 0x90, op->arg);
+		k->len += op->arg;
+		break;
+	case JIT_IDLE:		// mov eax, arg; 1: dec eax; jnz 1b
+		emit8(k, 0xb8);
+		emit32(k, op->arg);
+		emit8(k, 0xff);
+		emit8(k, 0xc8);
+		emit8(k, 0x75);
+		emit8(k, 0xfc);
+		break;
+	}
+}
+
+static void emit_push(JitKernel * k, int reg)
+{
+	if (reg >= R8)
+		emit8(k, 0x41);
+	emit8(k, 0x50 | (reg & 7));
+}
+
+static void emit_pop(JitKernel * k, int reg)
+{
+	if (reg >= R8)
+		emit8(k, 0x41);
+	emit8(k, 0x58 | (reg & 7));
+}
+
+/**
+Inputs: k - kernel with the schedule of a single iteration in k->ops
+        n_aggr - aggressors of the schedule, the size of v_lst
+
+Emits the schedule as straight-line x86-64 code looping for iters
+iterations. Up to JIT_REGS aggressor addresses are loaded into registers
+once, the hot loop has no other memory accesses than the schedule.
+
+Output: the kernel, valid until the next jit_compile()
+*/
+JitFn jit_compile(JitKernel * k, size_t n_aggr)
+{
+	size_t need = 256 + JIT_OP_BYTES * (n_aggr + k->n_ops);
+	for (size_t i = 0; i < k->n_ops; i++)
+		need += k->ops[i].type == JIT_NOP ? k->ops[i].arg : 0;
+	need = (need + getpagesize() - 1) & ~((size_t) getpagesize() - 1);
+
+	if (need > k->cap) {
+		if (k->code)
+			munmap(k->code, k->cap);
+		k->code = (uint8_t *) mmap(NULL, need, PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (k->code == MAP_FAILED) {
+			perror("[ERROR] - Unable to map the JIT buffer");
+			exit(1);
+		}
+		k->cap = need;
+	} else if (mprotect(k->code, k->cap, PROT_READ | PROT_WRITE)) {
+		perror("[ERROR] - mprotect() failed");
+		exit(1);
+	}
+
+	k->len = 0;
+	for (size_t i = 0; i < SAVED_CNT; i++)
+		emit_push(k, saved_regs[i]);
+	for (size_t i = 0; i < n_aggr && i < JIT_REGS; i++)
+		emit_load_addr(k, aggr_regs[i], i);
+
+	// test rsi, rsi; jz end
+	emit8(k, 0x48);
+	emit8(k, 0x85);
+	emit8(k, 0xf6);
+	emit8(k, 0x0f);
+	emit8(k, 0x84);
+	size_t jz = k->len;
+	emit32(k, 0);
+
+	size_t loop = k->len;
+	for (size_t i = 0; i < k->n_ops; i++)
+		emit_op(k, &k->ops[i]);
+
+	// dec rsi; jnz loop
+	emit8(k, 0x48);
+	emit8(k, 0xff);
+	emit8(k, 0xce);
+	emit8(k, 0x0f);
+	emit8(k, 0x85);
+	emit32(k, loop - (k->len + 4));
+
+	uint32_t rel = k->len - (jz + 4);
+	memcpy(&k->code[jz], &rel, sizeof(uint32_t));
+	for (size_t i = SAVED_CNT; i > 0; i--)
+		emit_pop(k, saved_regs[i - 1]);
+	emit8(k, 0xc3);	// ret
+	assert(k->len <= k->cap);
+
+	if (mprotect(k->code, k->cap, PROT_READ | PROT_EXEC)) {
+		perror("[ERROR] - mprotect() failed");
+		exit(1);
+	}
+	return (JitFn) k->code;
+}
+
+#else
+
+JitFn jit_compile(JitKernel * k, size_t n_aggr)
+{
+	// DUMMY: no emitter for this architecture, hammer_it() interprets the pattern
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "latency-probe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "dram-address.h"
+#include "addr-mapper.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+extern ProfileParams *p;
+
+static const char *kind_str[LP_KINDS] = { "same-row", "other-bank", "conflict" };
+
+static uint64_t lp_rand(uint64_t * s)
+{
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Two addresses of the given kind, random banks, rows and columns. */
+static void probe_pair(ADDRMapper * mapper, ProbeKind kind, uint64_t * s,
+		       char **a, char **b)
+{
+	size_t bks = get_banks_cnt();
+	size_t cls = ROW_SIZE / CL_SIZE;
+	DRAMAddr d_a, d_b;
+
+	d_a.bank = lp_rand(s) % bks;
+	d_a.row = mapper->base_row + lp_rand(s) % LP_ROWS;
+	d_a.col = (lp_rand(s) % cls) << CL_SHIFT;
+	d_b = d_a;
+	switch (kind) {
+	case LP_SAME_ROW:
+		d_b.col = ((d_a.col >> CL_SHIFT) + 1 + lp_rand(s) % (cls - 1)) % cls << CL_SHIFT;
+		break;
+	case LP_OTHER_BANK:
+		d_b.bank = (d_a.bank + 1 + lp_rand(s) % (bks - 1)) % bks;
+		d_b.row = mapper->base_row + lp_rand(s) % LP_ROWS;
+		break;
+	default:
+		d_b.row = mapper->base_row + (d_a.row - mapper->base_row + 1 + lp_rand(s) % (LP_ROWS - 1)) % LP_ROWS;
+		break;
+	}
+	*a = get_dram_pte(mapper, &d_a).v_addr;
+	*b = get_dram_pte(mapper, &d_b).v_addr;
+}
+
+static void hist_add(ProbeHist * h, uint64_t lat)
+{
+	size_t bin = lat / LP_BIN;
+	h->lin[bin < LP_BINS ? bin : LP_BINS - 1]++;
+	h->log2[lat ? 63 - __builtin_clzll(lat) : 0]++;
+	h->samples++;
+	h->sum += lat;
+}
+
+// lower edge of the linear bin holding quantile q
+static uint64_t hist_quantile(ProbeHist * h, double q)
+{
+	uint64_t want = q * h->samples, seen = 0;
+	for (size_t i = 0; i < LP_BINS; i++) {
+		seen += h->lin[i];
+		if (seen > want)
+			return i * LP_BIN;
+	}
+	return (LP_BINS - 1) * LP_BIN;
+}
+
+/* Non-empty bins only: kind,scale,lo,hi,count */
+static void export_hist(FILE * fp, ProbeKind kind, ProbeHist * h)
+{
+	for (size_t i = 0; i < LP_LOG_BINS; i++)
+		if (h->log2[i])
+			fprintf(fp, "%s,log2,%lu,%lu,%lu\n", kind_str[kind], 1UL << i,
+				i < 63 ? 1UL << (i + 1) : UINT64_MAX, h->log2[i]);
+	for (size_t i = 0; i < LP_BINS; i++)
+		if (h->lin[i])
+			fprintf(fp, "%s,lin,%lu,%lu,%lu\n", kind_str[kind], i * LP_BIN,
+				i + 1 < LP_BINS ? (i + 1) * LP_BIN : UINT64_MAX, h->lin[i]);
+}
+
+/**
+Inputs: mem - the hammer buffer, physmap set
+        samples - pairs timed per kind
+
+Times pairs of accesses to two columns of a row, to two banks and to two
+rows of a bank, drawn through the ADDRMapper from the first LP_ROWS rows
+of the buffer. The kinds are interleaved so that they see the same noise.
+The binned histograms go to DATA_DIR/<prefix>.latency.csv, see
+py/histogram.py. A wrong g_mem_layout shows as row conflicts that are
+not slower than accesses to other banks.
+
+Output: 0, -1 if the row conflicts can't be told apart
+*/
+int latency_probe(MemoryBuffer * mem, size_t samples)
+{
+	ADDRMapper *mapper = (ADDRMapper *) malloc(sizeof(ADDRMapper));
+	ProbeHist *hist = (ProbeHist *) calloc(LP_KINDS, sizeof(ProbeHist));
+	if (mapper == NULL || hist == NULL) {
+		fprintf(stderr, "[ERROR] - Unable to allocate the latency probe\n");
+		exit(1);
+	}
+	DRAMAddr d_base = phys_2_dram(virt_2_phys(mem->buffer, mem));
+	init_addr_mapper(mapper, mem, &d_base, LP_ROWS);
+
+	uint64_t seed = realtime_now();
+	uint64_t t0 = realtime_now();
+	for (size_t i = 0; i < samples; i++) {
+		for (int k = 0; k < LP_KINDS; k++) {
+			char *a, *b;
+			probe_pair(mapper, (ProbeKind) k, &seed, &a, &b);
+			hist_add(&hist[k], time_pair(a, b));
+		}
+	}
+	print_time("latency probe", realtime_now() - t0);
+
+	char *out_name = (char *)malloc(strlen(DATA_DIR) + strlen(p->g_out_prefix) + strlen(LP_EXT) + 1);
+	sprintf(out_name, "%s%s%s", DATA_DIR, p->g_out_prefix, LP_EXT);
+	create_dir(DATA_DIR);
+	FILE *fp = fopen(out_name, "w");
+	if (fp == NULL) {
+		perror("[ERROR] - Unable to open the latency output");
+		exit(1);
+	}
+	fprintf(fp, "kind,scale,lo,hi,count\n");
+	for (int k = 0; k < LP_KINDS; k++) {
+		ProbeHist *h = &hist[k];
+		export_hist(fp, (ProbeKind) k, h);
+		fprintf(stderr, "[STAT] - %-10s median: %4ld, p10: %4ld, p90: %4ld, mean: %.1f cycles\n",
+			kind_str[k], hist_quantile(h, 0.5), hist_quantile(h, 0.1),
+			hist_quantile(h, 0.9), (double)h->sum / h->samples);
+	}
+	fclose(fp);
+	fprintf(stderr, "[LOG] - File: %s\n", out_name);
+
+	uint64_t other = hist_quantile(&hist[LP_OTHER_BANK], 0.5);
+	double gap = (double)hist_quantile(&hist[LP_CONFLICT], 0.5) / (other ? other : 1);
+	int res = 0;
+	if (gap < LP_MIN_GAP) {
+		fprintf(stderr, "[ERROR] - Row conflicts are only %.2fx slower than other banks, check g_mem_layout\n", gap);
+		res = -1;
+	} else {
+		fprintf(stderr, "[LOG] - Row conflicts are %.2fx slower than other banks\n", gap);
+	}
+
+	free(out_name);
+	free(hist);
+	tear_down_addr_mapper(mapper);
+	free(mapper);
+	return res;
+}
@@ -22,6 +22,9 @@
 #include "include/dram-address.h"
 #include "include/hammer-suite.h"
 #include "include/params.h"
+#include "include/bench.h"
+#include "include/fliptable.h"
+#include "include/latency-probe.h"
 
 #ifdef NUC
 #include "utils-intel.h"
@@ -30,6 +33,7 @@
 #endif
 
 ProfileParams *p;
+uint64_t g_t_start;		// for the time-to-first-hammer report
 
 // DRAMLayout     g_mem_layout = {{{0x4080,0x88000,0x110000,0x220000,0x440000,0x4b300}, 6}, 0xffff80000, ((1<<13)-1)};
 // DRAMLayout 			g_mem_layout = { {{0x2040, 0x44000, 0x88000, 0x110000, 0x220000}, 5}, 0xffffc0000, ((1 << 13) - 1) };
@@ -58,6 +62,7 @@ void gmem_dump(DRAMLayout g_mem_layout)
 int main(int argc, char **argv)
 {
 	startup();
+	g_t_start = realtime_now();
 	p = (ProfileParams*)malloc(sizeof(ProfileParams));
 	if (p == NULL) {
 		fprintf(stderr, "[ERROR] Memory allocation\n");
@@ -72,6 +77,23 @@ int main(int argc, char **argv)
     // no fs on board, so can't pass args
 	manually_fill_params(p);
 
+	if (p->convert) {
+		int res = ft_convert(p->convert, stdout);
+		free(p);
+		exit(res ? 1 : 0);
+	}
+
+	fprintf(stderr, "[LOG] - Clock: %.3f ns/tick\n", calib_clock());
+	if (p->layout)
+		load_dram_layout(p->layout);
+	init_dram_xlate();
+
+	if (p->bench) {
+		int res = run_bench(p->bench);
+		free(p);
+		exit(res ? 1 : 0);
+	}
+
 	MemoryBuffer mem = {
 		.buffer = NULL,
 		.physmap = NULL,
@@ -81,10 +103,21 @@ int main(int argc, char **argv)
 		.flags = p->g_flags & MEM_MASK
 	};
 
+	uint64_t t0 = realtime_now();
 	alloc_buffer(&mem);
+	uint64_t t1 = realtime_now();
 	set_physmap(&mem);
+	uint64_t t2 = realtime_now();
+	print_time("alloc", t1 - t0);
+	print_time("physmap", t2 - t1);
 	gmem_dump(g_mem_layout);
 
+	if (p->latency_probe) {
+		int res = latency_probe(&mem, p->latency_probe);
+		close(p->huge_fd);
+		exit(res ? 1 : 0);
+	}
+
 	SessionConfig s_cfg;
 	memset(&s_cfg, 0, sizeof(SessionConfig));
 	if (p->g_flags & F_CONFIG) {
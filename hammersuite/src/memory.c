@@ -28,25 +28,26 @@ static int pmap_fd = NOT_OPENED;
 
 physaddr_t virt_2_phys(char *v_addr, MemoryBuffer * mem)
 {
-	// for (int i = 0; i < mem->size / PAGE_SIZE; i++) {
-	// 	if (mem->physmap[i].v_addr ==
-	// 	    (char *)((uint64_t) v_addr & ~((uint64_t) (PAGE_SIZE - 1))))
-	// 	{
-
-	// 		return mem->physmap[i].
-	// 		    p_addr | ((uint64_t) v_addr &
-	// 			      ((uint64_t) PAGE_SIZE - 1));
-	// 	}
-	// }
-	// return (physaddr_t) NOT_FOUND;
-	
-	return get_physaddr((uint64_t)v_addr, pmap_fd);
+	XlateCtx *ctx = &mem->xlate;
+	uint64_t off = (uint64_t) v_addr - (uint64_t) mem->buffer;
+
+	if (ctx->contig && off < mem->size)
+		return ctx->p_base + off;
 
-	
+	// physmap not set or address outside of the buffer
+	return get_physaddr((uint64_t)v_addr, pmap_fd);
 }
 
 
 char *phys_2_virt(physaddr_t p_addr, MemoryBuffer * mem)
 {
+	XlateCtx *ctx = &mem->xlate;
+
+	if (ctx->contig) {
+		uint64_t off = p_addr - ctx->p_base;
+		if (off < mem->size)
+			return mem->buffer + off;
+		return (char *)NOT_FOUND;
+	}
 	return phys_2_virt_helper(p_addr, mem);
 }
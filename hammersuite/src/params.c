@@ -59,6 +59,27 @@ void print_usage(char *bin_name)
 	fprintf(stderr, "\t-T --target-pattern\t= hex value for the target pattern\n");
 	fprintf(stderr, "\t-f --fuzzing\t\t= Start fuzzing (--aggr will be ignored)\n");
 	fprintf(stderr, "\t-t --threshold\t\t= Align the hammering to refresh ops,\n\t\t\t\t looking at the memory latency in CPU cycles.\t(default: 0)\n");
+	fprintf(stderr, "\t--vict-win rows\t\t= rows scanned around each aggressor, 0 = all\t(default: %d)\n", VICT_WIN_std);
+	fprintf(stderr, "\t--full-scan K\t\t= scan all rows every K patterns, 0 = never\t(default: %d)\n", FULL_SCAN_std);
+	fprintf(stderr, "\t--refresh-every N\t= rewrite all rows every N patterns, 0 = once\t(default: %d)\n", REFRESH_std);
+	fprintf(stderr, "\t--pipeline\t\t= scan/fill other banks while hammering\n");
+	fprintf(stderr, "\t--serialize\t\t= run the --pipeline stages one after the other, implies --pipeline\n");
+	fprintf(stderr, "\t--threads n\t\t= worker threads, at most %d\t\t\t(default: 1)\n", MAX_THREADS);
+	fprintf(stderr, "\t--duration s\t\t= stop fuzzing after s seconds, 0 = never\t(default: 0)\n");
+	fprintf(stderr, "\t--max-patterns n\t= stop fuzzing after n patterns over all runs\t(default: 0)\n");
+	fprintf(stderr, "\t--resume\t\t= continue the fuzzing session from its checkpoint\n");
+	fprintf(stderr, "\t--bandit\t\t= fuzz the tuples with the most flips/s more often\n");
+	fprintf(stderr, "\t--freq\t\t\t= fuzz patterns with a frequency, phase and amplitude per aggressor\n");
+	fprintf(stderr, "\t--jit\t\t\t= compile the hammer loop of every pattern to machine code\n");
+	fprintf(stderr, "\t--jit-nops n\t\t= NOPs after every access of the compiled loop, implies --jit\n");
+	fprintf(stderr, "\t--chunk rounds\t\t= check the victims every rounds, at least one tREFW (64ms) apart, and stop at the first flip\n");
+	fprintf(stderr, "\t--auto-rounds K\t\t= hammer every pattern for K refresh windows, overrides -r\n");
+	fprintf(stderr, "\t--refresh-sync\t\t= detect the refresh stalls and start hammering after one\n");
+	fprintf(stderr, "\t--refresh-phase pct\t= start pct%% of tREFI after the stall, implies --refresh-sync\t(default: 0)\n");
+	fprintf(stderr, "\t--layout f_name\t\t= DRAMLayout written by drama, instead of g_mem_layout\n");
+	fprintf(stderr, "\t--latency-probe n\t= time n access pairs per kind, write their histograms and exit\n");
+	fprintf(stderr, "\t--convert f_name\t= print a binary fliptable (.ft) as text and exit\n");
+	fprintf(stderr, "\t--bench name\t\t= run a microbenchmark and exit (xlate, scan, init, jit, all)\n");
 }
 
 static int str2pat(const char *str, char **pat)
@@ -108,6 +129,27 @@ int process_argv(int argc, char *argv[], ProfileParams *p)
 	p->huge_file = (char *)HUGETLB_std;
 	p->conf_file = (char *)CONFIG_NAME_std;
 	p->aggr      = AGGR_std;
+	p->bench     = (char *)NULL;
+	p->convert   = (char *)NULL;
+	p->vict_win  = VICT_WIN_std;
+	p->full_scan = FULL_SCAN_std;
+	p->threads   = 1;
+	p->refresh_every = REFRESH_std;
+	p->pipeline  = 0;
+	p->serialize = 0;
+	p->duration  = 0;
+	p->max_patterns = 0;
+	p->resume    = 0;
+	p->bandit    = 0;
+	p->freq      = 0;
+	p->jit       = 0;
+	p->jit_nops  = 0;
+	p->chunk     = 0;
+	p->auto_rounds = 0;
+	p->refresh_sync = 0;
+	p->refresh_phase = 0;
+	p->latency_probe = 0;
+	p->layout    = NULL;
 
 
 	const struct option long_options[] = {
@@ -124,6 +166,27 @@ int process_argv(int argc, char *argv[], ProfileParams *p)
 		{.name = "aggr",.has_arg = required_argument,.flag = NULL,.val='a'},
 		{.name = "fuzzing",.has_arg = no_argument,.flag = &p->fuzzing,.val = 1},
 		{.name = "threshold",.has_arg = required_argument,.flag = NULL,.val = 't'},
+		{"bench", required_argument, 0, 0},
+		{"vict-win", required_argument, 0, 0},
+		{"full-scan", required_argument, 0, 0},
+		{"threads", required_argument, 0, 0},
+		{"refresh-every", required_argument, 0, 0},
+		{.name = "pipeline",.has_arg = no_argument,.flag = &p->pipeline,.val = 1},
+		{.name = "serialize",.has_arg = no_argument,.flag = &p->serialize,.val = 1},
+		{"convert", required_argument, 0, 0},
+		{"duration", required_argument, 0, 0},
+		{"max-patterns", required_argument, 0, 0},
+		{.name = "resume",.has_arg = no_argument,.flag = &p->resume,.val = 1},
+		{.name = "bandit",.has_arg = no_argument,.flag = &p->bandit,.val = 1},
+		{.name = "freq",.has_arg = no_argument,.flag = &p->freq,.val = 1},
+		{.name = "jit",.has_arg = no_argument,.flag = &p->jit,.val = 1},
+		{"jit-nops", required_argument, 0, 0},
+		{"chunk", required_argument, 0, 0},
+		{"auto-rounds", required_argument, 0, 0},
+		{.name = "refresh-sync",.has_arg = no_argument,.flag = &p->refresh_sync,.val = 1},
+		{"refresh-phase", required_argument, 0, 0},
+		{"latency-probe", required_argument, 0, 0},
+		{"layout", required_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 
@@ -168,6 +231,62 @@ int process_argv(int argc, char *argv[], ProfileParams *p)
 			case 6:
 				p->g_flags |= F_NO_OVERWRITE;
 				break;
+			case 12:
+				p->bench = optarg;
+				break;
+			case 13:
+				p->vict_win = atoi(optarg);
+				break;
+			case 14:
+				p->full_scan = atoi(optarg);
+				break;
+			case 15:
+				p->threads = atoi(optarg);
+				if (p->threads < 1 || p->threads > MAX_THREADS) {
+					fprintf(stderr, "[ERROR] - --threads must be in [1, %d]\n", MAX_THREADS);
+					return -1;
+				}
+				break;
+			case 16:
+				p->refresh_every = atoi(optarg);
+				break;
+			case 19:
+				p->convert = optarg;
+				break;
+			case 20:
+				p->duration = atol(optarg);
+				break;
+			case 21:
+				p->max_patterns = atol(optarg);
+				break;
+			case 26:
+				p->jit_nops = atoi(optarg);
+				if (p->jit_nops > UINT16_MAX) {
+					fprintf(stderr, "[ERROR] - --jit-nops must be at most %d\n", UINT16_MAX);
+					return -1;
+				}
+				p->jit = 1;
+				break;
+			case 27:
+				p->chunk = atol(optarg);
+				break;
+			case 28:
+				p->auto_rounds = atol(optarg);
+				break;
+			case 30:
+				p->refresh_phase = atol(optarg);
+				if (p->refresh_phase >= 100) {
+					fprintf(stderr, "[ERROR] - --refresh-phase must be below 100\n");
+					return -1;
+				}
+				p->refresh_sync = 1;
+				break;
+			case 31:
+				p->latency_probe = atol(optarg);
+				break;
+			case 32:
+				p->layout = optarg;
+				break;
 			default:
 				break;
 			}
@@ -210,6 +329,13 @@ int process_argv(int argc, char *argv[], ProfileParams *p)
 			return -1;
 		}
 	}
+	if (p->serialize)
+		p->pipeline = 1;
+
+	// benchmarks and the converter don't need the hugetlbfs entry
+	if (p->bench || p->convert)
+		return 0;
+
 #ifdef HUGE_YES
 	p->g_flags |= F_ALLOC_HUGE_1G;
 #endif
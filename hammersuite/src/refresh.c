@@ -0,0 +1,159 @@
+#include "refresh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+extern ProfileParams *p;
+
+static int u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t u64_median(uint64_t * vals, size_t n)
+{
+	qsort(vals, n, sizeof(uint64_t), u64_cmp);
+	return vals[n / 2];
+}
+
+static uint64_t mono_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return TIMESPEC_NSEC(&ts);
+}
+
+/* Latency of a load of addr followed by its flush, the loop of -t. */
+static inline __attribute__ ((always_inline))
+uint64_t sample(volatile char *addr, uint64_t * t_start)
+{
+	uint64_t t0 = rdtscp();
+	*addr;
+	clflushopt(addr);
+	uint64_t t1 = rdtscp();
+	*t_start = t0;
+	return t1 - t0;
+}
+
+/**
+Inputs: rd - detector state
+        addr - address to sample, any row of the hammered rank
+
+Samples the latency of addr RF_SAMPLES times, picks the stall threshold
+from the histogram and the tREFI period from the start times of the stalls.
+A run of slow samples is a single stall. The period is only trusted if
+most intervals are close to their median, otherwise rd->threshold is 0.
+
+Output: 0 on success, -1 if no periodic stalls were found
+*/
+int refresh_detect(RefreshDet * rd, volatile char *addr)
+{
+	uint64_t *lat = (uint64_t *) malloc(sizeof(uint64_t) * RF_SAMPLES);
+	uint64_t *ts = (uint64_t *) malloc(sizeof(uint64_t) * RF_SAMPLES);
+	if (lat == NULL || ts == NULL) {
+		fprintf(stderr, "[ERROR] - Unable to allocate the refresh samples\n");
+		exit(1);
+	}
+	memset(rd, 0x00, sizeof(RefreshDet));
+
+	uint64_t t_ns = mono_ns();
+	for (size_t i = 0; i < RF_SAMPLES; i++)
+		lat[i] = sample(addr, &ts[i]);
+	t_ns = mono_ns() - t_ns;
+	rd->samples = RF_SAMPLES;
+	rd->ns_per_cycle = (double)t_ns / (ts[RF_SAMPLES - 1] - ts[0]);
+
+	for (size_t i = 0; i < RF_SAMPLES; i++) {
+		size_t bin = lat[i] / RF_BIN;
+		rd->hist[bin < RF_BINS ? bin : RF_BINS - 1]++;
+	}
+	uint64_t threshold = otsu_split(rd->hist, RF_BINS) * RF_BIN;
+
+	// start of every stall, reusing lat for the intervals
+	size_t n = 0;
+	uint64_t last = 0;
+	bool in_stall = false;
+	for (size_t i = 0; i < RF_SAMPLES; i++) {
+		bool slow = lat[i] >= threshold;
+		if (slow && !in_stall) {
+			if (n)
+				lat[n - 1] = ts[i] - last;
+			last = ts[i];
+			n++;
+		}
+		in_stall = slow;
+	}
+	rd->stalls = n;
+	free(ts);
+	if (n < RF_MIN_STALLS) {
+		free(lat);
+		return -1;
+	}
+
+	size_t n_int = n - 1;
+	uint64_t period = u64_median(lat, n_int);
+	size_t close = 0;
+	for (size_t i = 0; i < n_int; i++) {
+		lat[i] = lat[i] > period ? lat[i] - period : period - lat[i];
+		close += lat[i] < period / 4;
+	}
+	rd->jitter = u64_median(lat, n_int);
+	free(lat);
+	if (close * 2 < n_int)
+		return -1;
+
+	rd->threshold = threshold;
+	rd->period = period;
+	return 0;
+}
+
+/**
+Inputs: rd - detected or given (-t) threshold, period and offset
+        addr - address to sample
+
+Spins on addr until a sample stalls for rd->threshold cycles, then waits
+rd->offset cycles from the start of that sample. Without a period this
+is the -t loop: no timeout, no offset.
+
+Output: false if no stall was seen within RF_TIMEOUT periods
+*/
+bool refresh_wait(RefreshDet * rd, volatile char *addr)
+{
+	uint64_t t0, start = rdtscp();
+	uint64_t timeout = rd->period * RF_TIMEOUT;
+	while (sample(addr, &t0) < rd->threshold) {
+		if (timeout && t0 - start > timeout)
+			return false;
+	}
+	while (rdtscp() - t0 < rd->offset) ;
+	return true;
+}
+
+void refresh_report(RefreshDet * rd)
+{
+	fprintf(stderr, "[LOG] - Refresh: %ld stalls in %ld samples", rd->stalls, rd->samples);
+	if (rd->threshold)
+		fprintf(stderr, ", threshold %ld cycles, tREFI %ld cycles (%.0f ns, jitter %ld), offset %ld cycles\n",
+			rd->threshold, rd->period, rd->period * rd->ns_per_cycle, rd->jitter, rd->offset);
+	else
+		fprintf(stderr, ", no periodic refresh found, hammering unsynchronised\n");
+	if (p->g_flags & F_VERBOSE) {
+		fprintf(stderr, "[LOG] - Refresh latency (cycles: samples):");
+		for (size_t i = 0; i < RF_BINS; i++)
+			if (rd->hist[i])
+				fprintf(stderr, " %ld:%ld", i * RF_BIN, rd->hist[i]);
+		fprintf(stderr, "\n");
+	}
+}
@@ -59,54 +59,6 @@ int tear_down_buff(MemoryBuffer* mem) {
     return 0;
 }
 
-/**
-Inputs: p_addr - the physical address to get the column of
-        g_mem_layout - the listing of DRAM functions
-
-Using the mask in g_mem_layout, return the corresponding DRAM column of p_addr.
-
-DIFF: Since column bits aren't consecutive, we can't just downshift. Instead, we look at each bit of the phys. addr,
-		compare it to the mask, and change the col value if that bit is set in both the physical address & mask.
-
-Output: the column p_addr maps to
-*/
-uint64_t get_dram_col(physaddr_t p_addr, DRAMLayout g_mem_layout)
-{
-    uint64_t col = 0;
-    uint64_t colbit = 0;
-    for (uint64_t i = 0; i < 31; i++) {
-        if ((g_mem_layout.col_mask >> i) % 2 == 0) continue;
-        col += (((p_addr >> i) % 2) << colbit);
-        colbit++;
-    }
-    return col;
-}
-
-/**
-Inputs: d_addr - the DRAM representation to extract the physical bits from
-
-Given a DRAM representation d_addr, get the appropriate representation of column bits
-   in the physical address. To be XORed with the row/bank bits to get a full physical address.
-
-DIFF: Same as above.
-
-Output: the representation of this column as a physical address
-*/
-physaddr_t col_2_phys(DRAMAddr d_addr, DRAMLayout g_mem_layout) {
-	physaddr_t phys = 0;
-	uint64_t col = d_addr.col;
-	int colbit = 0;
-	for (int i = 0; i < 31; i++) {
-		if ((g_mem_layout.col_mask >> i) % 2 == 0) continue;
-		colbit = col % 2;
-		if (colbit) {
-			phys |= (1 << i);
-		}
-		col >>= 1;
-	}
-	return phys;
-}
-
 /**
 Inputs: g_mem_layout
 
@@ -160,14 +112,19 @@ int phys_cmp(const void *p1, const void *p2)
 /**
 Inputs: mem - holds the buffer data for reading the physmap
 
-Sets up the physmap--a sorted pagemap for the buffer. DUMMY.
+Sets up the physmap--a sorted pagemap for the buffer.
+
+DIFF: No pagemap. Physical and virtual addresses are the same, so the translation
+		context is just the buffer itself.
 
 Output: none
 */
 // WARNING optimization works only with contiguous memory!!
 void set_physmap(MemoryBuffer * mem)
 {
-	return;
+	mem->xlate.p_base = (physaddr_t) mem->buffer;
+	mem->xlate.pages = 0;
+	mem->xlate.contig = true;
 }
 
 /**
@@ -196,6 +153,17 @@ void sched_yield_helper() {
 	return;
 }
 
+/**
+Inputs: cpu - the cpu to run on
+
+Pins the calling thread to a cpu. DUMMY.
+
+Output: none
+*/
+void pin_thread(int cpu) {
+	return;
+}
+
 /**
 Inputs: p - holds the profile parameters
 
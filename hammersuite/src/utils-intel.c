@@ -5,6 +5,7 @@
 #ifdef NUC
 #include <sys/mman.h>
 #include <sched.h>
+#include <pthread.h>
 #include <fcntl.h>
 #endif
 #include <stdio.h>
@@ -17,7 +18,6 @@
 
 #include "memory.h"
 
-static int pmap_fd = NOT_OPENED;
 
 /**
 Inputs: None
@@ -91,32 +91,6 @@ int tear_down_buff(MemoryBuffer* mem) {
 	return munmap(mem->buffer, mem->size);
 }
 
-/**
-Inputs: p_addr - the physical address to get the column of
-        g_mem_layout - the listing of DRAM functions
-
-Using the mask in g_mem_layout, return the corresponding DRAM column of p_addr.
-
-Output: the column p_addr maps to
-*/
-uint64_t get_dram_col(physaddr_t p_addr, DRAMLayout g_mem_layout)
-{
-	return (p_addr & g_mem_layout.
-		col_mask) >> __builtin_ctzl(g_mem_layout.col_mask);
-}
-
-/**
-Inputs: d_addr - the DRAM representation to extract the physical bits from
-
-Given a DRAM representation d_addr, get the appropriate representation of column bits
-   in the physical address. To be XORed with the row/bank bits to get a full physical address.
-
-Output: the representation of this column as a physical address
-*/
-physaddr_t col_2_phys(DRAMAddr d_addr, DRAMLayout g_mem_layout) {
-	return (d_addr.col << __builtin_ctzl(g_mem_layout.col_mask));	// set col bits
-}
-
 /**
 Inputs: g_mem_layout
 
@@ -199,20 +173,48 @@ Output: whichever pte has a larger physical address
 */
 int phys_cmp(const void *p1, const void *p2)
 {
-	return ((pte_t *) p1)->p_addr - ((pte_t *) p2)->p_addr;
+	physaddr_t a = ((pte_t *) p1)->p_addr;
+	physaddr_t b = ((pte_t *) p2)->p_addr;
+	// the difference of two physical addresses doesn't fit an int
+	return (a > b) - (a < b);
+}
+
+// size of the pages backing the buffer, same order of checks as build_buffer()
+static uint64_t backing_page(MemoryBuffer * mem)
+{
+	if (mem->flags & BIT_SET(MEM_SHIFT + 1))
+		return 1ULL << 30;
+	if (mem->flags & BIT_SET(MEM_SHIFT + 2))
+		return 1ULL << 21;
+	return sysconf(_SC_PAGESIZE);
+}
+
+// every backing page of the buffer follows the previous one in physical memory
+static bool is_contig(MemoryBuffer * mem, int pmap_fd)
+{
+	uint64_t page = backing_page(mem);
+	for (uint64_t off = page; off < mem->size; off += page) {
+		if (get_physaddr((uint64_t) mem->buffer + off, pmap_fd) != base_phys + off)
+			return false;
+	}
+	return true;
 }
 
 /**
 Inputs: mem - holds the buffer data for reading the physmap
 
-Sets up the physmap--a sorted pagemap for the buffer
+Sets up the physmap--a sorted pagemap for the buffer--and caches the
+translation context in mem->xlate. If the pages turn out to be physically
+contiguous phys<->virt becomes a plain offset from the physical base.
+Contiguity is checked at the size of the pages backing the buffer, the
+physmap itself keeps the PAGE_SIZE stride.
 
 Output: none
 */
 // WARNING optimization works only with contiguous memory!!
 void set_physmap(MemoryBuffer * mem)
 {
-	int l_size = mem->size / PAGE_SIZE;
+	int l_size = (mem->size + PAGE_SIZE - 1) / PAGE_SIZE;
 	pte_t *physmap = (pte_t *) malloc(sizeof(pte_t) * l_size);
 	int pmap_fd = open("/proc/self/pagemap", O_RDONLY);
 	assert(pmap_fd >= 0);
@@ -225,9 +227,13 @@ void set_physmap(MemoryBuffer * mem)
 		idx++;
 	}
 
-	qsort(physmap, mem->size / PAGE_SIZE, sizeof(pte_t), phys_cmp);
-	close(pmap_fd);
+	qsort(physmap, l_size, sizeof(pte_t), phys_cmp);
 	mem->physmap = physmap;
+
+	mem->xlate.p_base = base_phys;
+	mem->xlate.pages = l_size;
+	mem->xlate.contig = is_contig(mem, pmap_fd);
+	close(pmap_fd);
 }
 
 /**
@@ -243,16 +249,12 @@ char* phys_2_virt_helper(physaddr_t p_addr, MemoryBuffer* mem) {
 	physaddr_t p_page = p_addr & ~(((uint64_t) PAGE_SIZE - 1));
 	pte_t src_pte = {.v_addr = 0,.p_addr = p_page };
 	pte_t *res_pte =
-	    (pte_t *) bsearch(&src_pte, mem->physmap, mem->size / PAGE_SIZE,
+	    (pte_t *) bsearch(&src_pte, mem->physmap, mem->xlate.pages,
 			      sizeof(pte_t), phys_cmp);
 
 	if (res_pte == NULL)
 		return (char *)NOT_FOUND;
 
-    uint64_t physical_base = get_physaddr((uint64_t)mem->buffer, pmap_fd);
-
-	// fprintf(stderr, "phy_base: %lx\n", physical_base);
-
 	return (char *)((uint64_t) res_pte->
 			v_addr | ((uint64_t) p_addr &
 				  (((uint64_t) PAGE_SIZE - 1))));
@@ -272,6 +274,21 @@ void sched_yield_helper() {
 	sched_yield();
 }
 
+/**
+Inputs: cpu - the cpu to run on, wraps around the online cpus
+
+Pins the calling thread, so that hammering threads don't migrate between cores.
+
+Output: none
+*/
+void pin_thread(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % sysconf(_SC_NPROCESSORS_ONLN), &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set))
+		fprintf(stderr, "[LOG] - Unable to pin thread to cpu %d\n", cpu);
+}
+
 /**
 Inputs: p - holds the profile parameters
 
@@ -17,7 +17,14 @@
 
 #include "memory.h"
 
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
 #define PAGE_BITS 12
+#define CLOCK_CALIB_NS	10000000UL	// busy wait of calib_clock()
 
 #define FLAGS (MAP_PRIVATE | MAP_POPULATE | MAP_HUGETLB | (30<<MAP_HUGE_SHIFT))
 
@@ -27,6 +34,34 @@ char *get_rnd_addr(char *base, size_t m_size, size_t align)
 			(~((uint64_t) align - 1)));
 }
 
+static double ns_per_tick = 1.0;
+
+/**
+Inputs: none
+
+Times realtime_now() against CLOCK_MONOTONIC. realtime_now() counts ns on
+Intel but PMCCNTR_EL0 cycles on ARM, ticks_2_ns() converts either.
+
+Output: ns per tick of realtime_now()
+*/
+double calib_clock()
+{
+	struct timespec ts0, ts1;
+	clock_gettime(CLOCK_MONOTONIC, &ts0);
+	uint64_t t0 = realtime_now();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &ts1);
+	} while (TIMESPEC_NSEC(&ts1) - TIMESPEC_NSEC(&ts0) < CLOCK_CALIB_NS);
+	uint64_t t1 = realtime_now();
+	ns_per_tick = (TIMESPEC_NSEC(&ts1) - TIMESPEC_NSEC(&ts0)) / (double)(t1 - t0);
+	return ns_per_tick;
+}
+
+uint64_t ticks_2_ns(uint64_t ticks)
+{
+	return ticks * ns_per_tick;
+}
+
 int get_rnd_int(int min, int max)
 {
 	return rand() % (max + 1 - min) + min;
@@ -54,6 +89,45 @@ uint64_t median(uint64_t * vals, size_t size)
 				       vals[((size_t) size / 2 + 1)]) / 2;
 }
 
+/**
+Inputs: hist - latency histogram
+        bins - entries of hist
+
+Otsu split of the histogram above its mode: the bin that best separates
+the common latency from the slow tail (row conflicts, refresh stalls).
+
+Output: first bin of the slow class
+*/
+size_t otsu_split(const uint64_t * hist, size_t bins)
+{
+	size_t mode = 0;
+	for (size_t i = 0; i < bins; i++)
+		mode = hist[i] > hist[mode] ? i : mode;
+
+	double n = 0, sum = 0;
+	for (size_t i = mode; i < bins; i++) {
+		n += hist[i];
+		sum += (double)i * hist[i];
+	}
+
+	double n0 = 0, sum0 = 0, best = 0;
+	size_t split = bins - 1;
+	for (size_t i = mode; i < bins - 1; i++) {
+		n0 += hist[i];
+		sum0 += (double)i * hist[i];
+		double n1 = n - n0;
+		if (n0 == 0 || n1 == 0)
+			continue;
+		double d = sum0 / n0 - (sum - sum0) / n1;
+		double var = n0 * n1 * d * d;
+		if (var > best) {
+			best = var;
+			split = i;
+		}
+	}
+	return split + 1;
+}
+
 char *bit_string(uint64_t val)
 {
 	static char bit_str[256];
@@ -83,4 +157,12 @@ char *int_2_bin(uint64_t val)
 	}
 
 	return bit_str;
-}
\ No newline at end of file
+}
+
+/*
+ Startup timing report, ticks is a realtime_now() difference.
+ */
+void print_time(const char *what, uint64_t ticks)
+{
+	fprintf(stderr, "[TIME] - %-14s %10.2f ms\n", what, (double)ticks_2_ns(ticks) / 1e6);
+}
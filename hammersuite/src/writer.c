@@ -0,0 +1,279 @@
+#include "writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "params.h"
+
+#ifdef NUC
+#include "utils-intel.h"
+#elif defined ZUBOARD
+#include "utils-arm.h"
+#endif
+
+extern ProfileParams *p;
+
+static EventRing ring;
+
+/* State of the writer thread, only touched by the consumer. */
+static struct {
+	FlipTable *ft;
+	uint32_t *rows;		// aggressor rows of the current pattern
+	size_t len;
+	size_t cap;
+	size_t want;		// rows announced by FT_PATT
+	bool stop;
+	bool flush;		// writer_flush() request
+	bool running;
+	pthread_t tid;
+} wr;
+
+static void print_aggrs(FILE * fp, uint64_t bk, bool bank)
+{
+	for (size_t i = 0; i < wr.len; i++) {
+		fprintf(fp, "r%05u", wr.rows[i]);
+		if (bank)
+			fprintf(fp, ".bk%02lu", bk);
+		if (i + 1 != wr.len)
+			fprintf(fp, "/");
+	}
+}
+
+static void handle_record(FTRecord * rec)
+{
+	ft_push(wr.ft, rec, 1);
+	switch (rec->type) {
+	case FT_PATT:
+		if (rec->val > wr.cap) {
+			wr.cap = rec->val;
+			wr.rows = (uint32_t *) realloc(wr.rows, sizeof(uint32_t) * wr.cap);
+			assert(wr.rows != NULL);
+		}
+		wr.len = 0;
+		wr.want = rec->val;
+		break;
+	case FT_AGGR:
+		wr.rows[wr.len++] = rec->row;
+		if (wr.len == wr.want) {
+			fprintf(stderr, "[HAMMER] - ");
+			print_aggrs(stderr, 0, false);
+			fprintf(stderr, ": ");
+		}
+		break;
+	case FT_TIME:
+		fprintf(stderr, "%ld ", ((uint64_t) rec->row * 1000 + rec->col) / 1000000);
+		break;
+	case FT_FLIP:
+		if (p->g_flags & F_VERBOSE) {
+			fprintf(stdout, "[FLIP] - (%02x => %02x)\t vict: r%05u.bk%02u.col%04u \taggr: ",
+				rec->f_og, rec->f_new, rec->row, rec->bank, rec->col);
+			print_aggrs(stdout, rec->bank, true);
+			fprintf(stdout, " \n");
+			fflush(stdout);
+		}
+		break;
+	}
+}
+
+static void handle(Event * ev)
+{
+	switch (ev->type) {
+	case EV_REC:
+		handle_record(&ev->rec);
+		break;
+	case EV_EOL:
+		fprintf(stderr, "\n");
+		fflush(stderr);
+		break;
+	}
+}
+
+static void *writer_loop(void *arg)
+{
+	uint64_t tail = ring.tail;
+	while (1) {
+		uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		if (tail == head) {
+			if (__atomic_load_n(&wr.stop, __ATOMIC_ACQUIRE))
+				break;
+			if (__atomic_load_n(&wr.flush, __ATOMIC_ACQUIRE)) {
+				ft_flush(wr.ft);
+				__atomic_store_n(&wr.flush, false, __ATOMIC_RELEASE);
+				continue;
+			}
+			if (wr.ft && ticks_2_ns(realtime_now() - wr.ft->t_flush) > FT_FLUSH_NS)
+				ft_flush(wr.ft);
+			usleep(WRITER_IDLE_US);
+			continue;
+		}
+		for (; tail != head; tail++)
+			handle(&ring.ev[tail & (RING_SIZE - 1)]);
+		__atomic_store_n(&ring.tail, tail, __ATOMIC_RELEASE);
+	}
+	ft_flush(wr.ft);
+	return NULL;
+}
+
+/*
+ Push an event from the current producer. Records wait for room in the
+ ring, log events are dropped rather than stalling the hammer path.
+ */
+static void push(Event * ev, bool wait)
+{
+	if (!wr.running) {
+		handle(ev);
+		return;
+	}
+
+	uint64_t head = ring.head;
+	if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+		if (!wait) {
+			ring.dropped++;
+			return;
+		}
+		ring.waits++;
+		while (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) == RING_SIZE)
+			sched_yield();
+	}
+	ring.ev[head & (RING_SIZE - 1)] = *ev;
+	ring.events++;
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+Inputs: ft - fliptable owned by the writer from now on, can be NULL
+
+Starts the writer thread. Until then, and after writer_stop(), events are
+handled synchronously by the caller.
+
+Output: none
+*/
+void writer_start(FlipTable * ft)
+{
+	wr.ft = ft;
+	if (ring.ev == NULL) {
+		ring.ev = (Event *) malloc(sizeof(Event) * RING_SIZE);
+		assert(ring.ev != NULL);
+	}
+	wr.stop = false;
+	if (pthread_create(&wr.tid, NULL, writer_loop, NULL)) {
+		fprintf(stderr, "[ERROR] - Unable to start the writer thread\n");
+		exit(1);
+	}
+	wr.running = true;
+}
+
+/* Wait until the writer has handled every event pushed so far. */
+void writer_sync()
+{
+	if (!wr.running)
+		return;
+	while (__atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) != ring.head)
+		usleep(WRITER_IDLE_US);
+}
+
+/* Handle every pending event and write the fliptable buffer to disk. */
+void writer_flush()
+{
+	if (!wr.running) {
+		ft_flush(wr.ft);
+		return;
+	}
+	writer_sync();
+	__atomic_store_n(&wr.flush, true, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&wr.flush, __ATOMIC_ACQUIRE))
+		usleep(WRITER_IDLE_US);
+}
+
+void writer_stop()
+{
+	if (!wr.running)
+		return;
+	__atomic_store_n(&wr.stop, true, __ATOMIC_RELEASE);
+	pthread_join(wr.tid, NULL);
+	wr.running = false;
+	writer_report();
+}
+
+void writer_report()
+{
+	fprintf(stderr, "[STAT] - writer: %ld events, %ld backpressure waits, %ld dropped\n",
+		ring.events, ring.waits, ring.dropped);
+}
+
+void out_record(FTRecord * rec)
+{
+	Event ev;
+	ev.type = EV_REC;
+	ev.rec = *rec;
+	push(&ev, true);
+}
+
+/**
+Inputs: d_lst - aggressors
+        f_lst - their frequency, phase and amplitude, NULL for a uniform pattern
+        len - aggressors
+        rounds - hammer rounds
+        table - one text line per bank, see ft_convert()
+
+Opens a pattern with its FT_PATT record and one FT_AGGR record per aggressor.
+
+Output: none
+*/
+void out_pattern(DRAMAddr * d_lst, AggrFreq * f_lst, size_t len, size_t rounds, bool table)
+{
+	FTRecord rec;
+	memset(&rec, 0x00, sizeof(FTRecord));
+	rec.type = FT_PATT;
+	rec.flags = (table ? FT_TABLE : 0) | (f_lst ? FT_FREQ : 0);
+	rec.row = rounds < UINT32_MAX ? rounds : UINT32_MAX;
+	rec.val = len;
+	out_record(&rec);
+
+	rec.type = FT_AGGR;
+	rec.flags = 0;
+	rec.val = 0;
+	for (size_t i = 0; i < len; i++) {
+		rec.row = d_lst[i].row;
+		if (f_lst) {
+			rec.col = f_lst[i].phase;
+			rec.val = (uint32_t) f_lst[i].freq << 16 | f_lst[i].amp;
+		}
+		out_record(&rec);
+	}
+}
+
+/**
+Inputs: bk - bank
+        ns - hammer time of the bank
+        acts - activations of the bank
+
+Closes the bank with a FT_TIME record, printed in ms on the [HAMMER] line.
+
+Output: none
+*/
+void out_time(size_t bk, uint64_t ns, uint64_t acts)
+{
+	FTRecord rec;
+	memset(&rec, 0x00, sizeof(FTRecord));
+	rec.type = FT_TIME;
+	rec.bank = bk;
+	rec.row = ns / 1000 < UINT32_MAX ? ns / 1000 : UINT32_MAX;
+	rec.col = ns % 1000;
+	uint64_t rate = ns ? (uint64_t) ((double)acts * 1e9 / ns) : 0;
+	rec.val = rate < UINT32_MAX ? rate : UINT32_MAX;
+	out_record(&rec);
+}
+
+void out_eol()
+{
+	Event ev;
+	ev.type = EV_EOL;
+	push(&ev, false);
+}
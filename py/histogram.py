@@ -4,6 +4,23 @@ import matplotlib.pyplot as plt
 
 num_bins = 200
 
+
+def plot_binned(reader, ax):
+    # tester --latency-probe output: kind,scale,lo,hi,count
+    kinds = {}
+    for row in reader:
+        if row[1] != "lin":
+            continue
+        kinds.setdefault(row[0], ([], []))
+        kinds[row[0]][0].append(int(row[2]))
+        kinds[row[0]][1].append(int(row[4]))
+    for kind, (lo, cnt) in kinds.items():
+        print(f'{kind}: {sum(cnt)} points')
+        ax.hist(lo, bins=num_bins, weights=cnt, histtype="step", label=kind)
+    ax.set_xlabel("Access time [cycles]")
+    ax.legend()
+
+
 if __name__ == "__main__":
 
     if len(sys.argv) != 2:
@@ -11,16 +28,19 @@ if __name__ == "__main__":
         exit(1)
 
     csvFile = open(sys.argv[1], "r")
-    csvFile.readline()  # skip first line
+    header = csvFile.readline()
 
     reader = csv.reader(csvFile, delimiter=',')
-    x = []
-    for row in reader:
-        x.append(int(row[len(row) - 1]))
-
-    print(f'Number of point {len(x)}')
     fig, ax = plt.subplots()
-    n, bins, patches = ax.hist(x, num_bins, density=False)
-    ax.set_xlabel("Access time [ns]")
+    if header.strip() == "kind,scale,lo,hi,count":
+        plot_binned(reader, ax)
+    else:
+        x = []
+        for row in reader:
+            x.append(int(row[len(row) - 1]))
+
+        print(f'Number of point {len(x)}')
+        n, bins, patches = ax.hist(x, num_bins, density=False)
+        ax.set_xlabel("Access time [ns]")
     ax.set_ylabel("proportion of cases")
     plt.show()